@@ -0,0 +1,92 @@
+#ifndef TREE_SITTER_ZSH_BENCH_H_
+#define TREE_SITTER_ZSH_BENCH_H_
+
+// Helpers shared by the programs in bench/, each of which is a single
+// translation unit including this header after its feature test macros.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static inline double now_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Reads the whole file at `path`, followed by a '\0' that is not counted in
+// `size`. Returns NULL if the file cannot be opened.
+static inline char *read_file(const char *path, uint32_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long end = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    size_t length = end > 0 ? (size_t)end : 0;
+    char *bytes = malloc(length + 1);
+    *size = (uint32_t)fread(bytes, 1, length, file);
+    bytes[*size] = '\0';
+    fclose(file);
+    return bytes;
+}
+
+// Calls `add_line` with every non-empty line of the file at `path` that does
+// not start with '#', stopping at the first line it rejects.
+static inline bool read_lines(const char *path, void *context,
+                              bool (*add_line)(void *, char *)) {
+    uint32_t size = 0;
+    char *contents = read_file(path, &size);
+    if (!contents) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return false;
+    }
+    bool ok = true;
+    uint32_t line_number = 0;
+    char *line = contents;
+    char *end = contents + size;
+    while (ok && line < end) {
+        char *newline = memchr(line, '\n', (size_t)(end - line));
+        char *line_end = newline ? newline : end;
+        if (line_end > line && line_end[-1] == '\r') {
+            line_end[-1] = '\0';
+        }
+        *line_end = '\0';
+        line_number++;
+        if (*line && *line != '#') {
+            ok = add_line(context, line);
+            if (!ok) {
+                fprintf(stderr, "%s:%u: invalid line\n", path, line_number);
+            }
+        }
+        line = line_end + 1;
+    }
+    free(contents);
+    return ok;
+}
+
+// Runs `worker` with `payload` on `threads` threads, including the calling
+// one, and waits for all of them. Fewer threads are used if some cannot be
+// started. The programs using it link with -pthread.
+static inline void run_threads(uint32_t threads, void *(*worker)(void *),
+                               void *payload) {
+    pthread_t *workers = threads > 1 ? calloc(threads - 1, sizeof(pthread_t))
+                                     : NULL;
+    uint32_t started = 0;
+    while (workers && started < threads - 1 &&
+           pthread_create(&workers[started], NULL, worker, payload) == 0) {
+        started++;
+    }
+    worker(payload);
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+}
+
+#endif // TREE_SITTER_ZSH_BENCH_H_
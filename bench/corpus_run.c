@@ -0,0 +1,244 @@
+/**
+ * Parallel corpus runner.
+ *
+ * Parses every input file with the tree-sitter runtime on a pool of threads,
+ * each with its own parser, and records the size, node count, parse time and
+ * error state of every file. The results are written with -o as a
+ * tab-separated file with one line per input, in input order, which
+ * script/corpus-diff compares with a stored baseline; that is how
+ * script/parse-examples tracks both the files that fail to parse and the
+ * files that take longest.
+ *
+ * Files are handed to the threads largest first, so that a large file picked
+ * up last does not leave the other threads idle at the end of the run. Each
+ * file is parsed `passes` times and the fastest parse is recorded, which keeps
+ * the per-file times of a loaded machine comparable between runs. A file that
+ * cannot be read is recorded as unreadable rather than stopping the run.
+ *
+ * Files are taken from the command line and, with -l, from a list with one
+ * path per line such as the script/example-files.txt written by
+ * script/parse-examples. A summary is printed as `key: value` lines in the
+ * same format as parse-bench. Without -j, one thread per CPU is used.
+ *
+ * Usage: corpus-run [-j threads] [-p passes] [-o results] [-l list] FILE...
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <tree_sitter/api.h>
+
+#include "tree_sitter/tree-sitter-zsh.h"
+
+#include "bench.h"
+
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef enum {
+    STATUS_OK,
+    STATUS_ERROR,
+    STATUS_UNREADABLE,
+} CorpusStatus;
+
+static const char *const StatusNames[] = {"ok", "error", "unreadable"};
+
+typedef struct {
+    char *path;
+    off_t size;
+    // Output
+    CorpusStatus status;
+    uint32_t length;
+    uint32_t nodes;
+    double seconds;
+} CorpusFile;
+
+typedef struct {
+    CorpusFile *contents;
+    uint32_t size;
+    uint32_t capacity;
+} CorpusFiles;
+
+typedef struct {
+    CorpusFiles *files;
+    // Indices into files, largest file first
+    uint32_t *order;
+    uint32_t passes;
+    _Atomic uint32_t next;
+} CorpusJob;
+
+static void add_file(CorpusFiles *files, const char *path) {
+    if (files->size == files->capacity) {
+        files->capacity = files->capacity ? files->capacity * 2 : 64;
+        files->contents =
+            realloc(files->contents, files->capacity * sizeof(CorpusFile));
+    }
+    CorpusFile *file = &files->contents[files->size++];
+    memset(file, 0, sizeof(*file));
+    file->path = malloc(strlen(path) + 1);
+    strcpy(file->path, path);
+}
+
+static bool add_list_line(void *files, char *line) {
+    add_file(files, line);
+    return true;
+}
+
+static void parse_file(TSParser *parser, CorpusFile *file, uint32_t passes) {
+    uint32_t length = 0;
+    char *source = read_file(file->path, &length);
+    if (!source) {
+        file->status = STATUS_UNREADABLE;
+        return;
+    }
+    file->length = length;
+    for (uint32_t pass = 0; pass < passes; pass++) {
+        double start = now_seconds();
+        TSTree *tree = ts_parser_parse_string(parser, NULL, source, length);
+        double seconds = now_seconds() - start;
+        if (pass == 0 || seconds < file->seconds) {
+            file->seconds = seconds;
+        }
+        if (pass == 0) {
+            TSNode root = ts_tree_root_node(tree);
+            file->status = ts_node_has_error(root) ? STATUS_ERROR : STATUS_OK;
+            file->nodes = ts_node_descendant_count(root);
+        }
+        ts_tree_delete(tree);
+    }
+    free(source);
+}
+
+static void *parse_worker(void *payload) {
+    CorpusJob *job = payload;
+    TSParser *parser = ts_parser_new();
+    ts_parser_set_language(parser, tree_sitter_zsh());
+    for (;;) {
+        uint32_t index = atomic_fetch_add(&job->next, 1);
+        if (index >= job->files->size) {
+            break;
+        }
+        parse_file(parser, &job->files->contents[job->order[index]],
+                   job->passes);
+    }
+    ts_parser_delete(parser);
+    return NULL;
+}
+
+static CorpusFiles *sorted_files;
+
+static int compare_size(const void *a, const void *b) {
+    off_t a_size = sorted_files->contents[*(const uint32_t *)a].size;
+    off_t b_size = sorted_files->contents[*(const uint32_t *)b].size;
+    return (a_size < b_size) - (a_size > b_size);
+}
+
+static bool write_results(const CorpusFiles *files, const char *path) {
+    FILE *output = fopen(path, "w");
+    if (!output) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return false;
+    }
+    fprintf(output, "path\tbytes\tnodes\tms\tstatus\n");
+    for (uint32_t i = 0; i < files->size; i++) {
+        const CorpusFile *file = &files->contents[i];
+        fprintf(output, "%s\t%u\t%u\t%.3f\t%s\n", file->path, file->length,
+                file->nodes, file->seconds * 1e3, StatusNames[file->status]);
+    }
+    return fclose(output) == 0;
+}
+
+int main(int argc, char **argv) {
+    static const char usage[] =
+        "usage: %s [-j threads] [-p passes] [-o results] [-l list] FILE...\n";
+    long threads = 0;
+    uint32_t passes = 1;
+    const char *results = NULL;
+    CorpusFiles files = {NULL, 0, 0};
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            threads = strtol(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            passes = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            results = argv[++i];
+        } else if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+            if (!read_lines(argv[++i], &files, add_list_line)) {
+                return 1;
+            }
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, usage, argv[0]);
+            return 1;
+        } else {
+            add_file(&files, argv[i]);
+        }
+    }
+    if (files.size == 0 || passes == 0 || threads < 0) {
+        fprintf(stderr, usage, argv[0]);
+        return 1;
+    }
+
+    TSParser *parser = ts_parser_new();
+    if (!ts_parser_set_language(parser, tree_sitter_zsh())) {
+        fprintf(stderr, "incompatible tree-sitter runtime\n");
+        return 1;
+    }
+    ts_parser_delete(parser);
+
+    if (threads == 0) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads > (long)files.size) {
+        threads = (long)files.size;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    uint32_t *order = malloc(files.size * sizeof(uint32_t));
+    for (uint32_t i = 0; i < files.size; i++) {
+        struct stat info;
+        CorpusFile *file = &files.contents[i];
+        file->size = stat(file->path, &info) == 0 ? info.st_size : 0;
+        order[i] = i;
+    }
+    sorted_files = &files;
+    qsort(order, files.size, sizeof(uint32_t), compare_size);
+
+    CorpusJob job = {&files, order, passes, 0};
+    double start = now_seconds();
+    run_threads((uint32_t)threads, parse_worker, &job);
+    double elapsed = now_seconds() - start;
+
+    uint64_t bytes = 0;
+    uint32_t counts[3] = {0, 0, 0};
+    double parse_seconds = 0.0;
+    for (uint32_t i = 0; i < files.size; i++) {
+        CorpusFile *file = &files.contents[i];
+        bytes += file->length;
+        parse_seconds += file->seconds;
+        counts[file->status]++;
+        if (file->status == STATUS_UNREADABLE) {
+            fprintf(stderr, "cannot read %s\n", file->path);
+        }
+    }
+
+    printf("files: %u\n", files.size);
+    printf("threads: %ld\n", threads);
+    printf("passes: %u\n", passes);
+    printf("bytes: %llu\n", (unsigned long long)bytes);
+    printf("error_files: %u\n", counts[STATUS_ERROR]);
+    printf("unreadable_files: %u\n", counts[STATUS_UNREADABLE]);
+    printf("seconds: %.6f\n", elapsed);
+    printf("parse_seconds: %.6f\n", parse_seconds);
+    printf("mb_per_second: %.2f\n",
+           elapsed > 0 ? (double)bytes / elapsed / 1e6 : 0.0);
+
+    bool ok = !results || write_results(&files, results);
+    for (uint32_t i = 0; i < files.size; i++) {
+        free(files.contents[i].path);
+    }
+    free(files.contents);
+    free(order);
+    return ok ? 0 : 1;
+}
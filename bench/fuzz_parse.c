@@ -0,0 +1,228 @@
+/**
+ * Worst-case parse time check.
+ *
+ * Parses inputs with the tree-sitter runtime and reports any whose parse time
+ * exceeds a linear budget, which is how super-linear behavior in the scanner
+ * or the grammar shows up: a run of `$`, deeply nested `$(( ( (`, an
+ * unterminated `${` or thousands of heredocs that take far longer per byte
+ * than ordinary scripts do.
+ *
+ * The budget scales with the machine: before checking anything the parse
+ * time per byte of an ordinary script (the reference below, repeated to
+ * 64 KiB) is measured, and an input of n bytes may then take
+ *
+ *     slack + factor * reference_ns_per_byte * n
+ *
+ * where the fixed slack absorbs the setup cost and timer noise of small
+ * inputs. An input over budget is timed twice more and only reported when
+ * the fastest of the three runs is still over.
+ *
+ * Built with TREE_SITTER_ZSH_LIBFUZZER and -fsanitize=fuzzer, this is a
+ * libFuzzer target that aborts on the first input over budget, so that the
+ * fuzzer saves it; the factor and slack are then taken from the environment
+ * variables TREE_SITTER_ZSH_FUZZ_FACTOR and TREE_SITTER_ZSH_FUZZ_SLACK_MS.
+ * Otherwise it checks the files given on the command line, such as the
+ * regression corpus in test/slow, printing `key: value` lines in the same
+ * format as parse-bench and exiting with status 1 if any file is over budget.
+ *
+ * Usage: fuzz-parse [-f factor] [-m slack_ms] FILE...
+ */
+
+#include <tree_sitter/api.h>
+
+#include "tree_sitter/tree-sitter-zsh.h"
+
+#include "bench.h"
+
+#define DEFAULT_FACTOR 50.0
+#define DEFAULT_SLACK_MS 5.0
+#define REFERENCE_SIZE (64 * 1024)
+#define RUNS 3
+
+static const char reference[] =
+    "#!/usr/bin/env zsh\n"
+    "# ordinary configuration, used to calibrate the budget\n"
+    "typeset -gA colors=(red 1 green 2)\n"
+    "path=($HOME/bin ${path:#/usr/games})\n"
+    "for f in ${ZDOTDIR:-$HOME}/conf.d/*.zsh(N); do\n"
+    "  [[ -r $f ]] && source \"$f\"\n"
+    "done\n"
+    "prompt_git() {\n"
+    "  local branch=$(git symbolic-ref --short HEAD 2>/dev/null)\n"
+    "  if (( ${#branch} > 0 )); then\n"
+    "    print -n \"%F{green}${branch:t}%f \"\n"
+    "  fi\n"
+    "}\n"
+    "case $TERM in\n"
+    "  xterm*|rxvt*) print -Pn '\\e]0;%~\\a' ;;\n"
+    "  *) ;;\n"
+    "esac\n"
+    "cat <<EOF >> $log\n"
+    "started $(date +%s) in $PWD\n"
+    "EOF\n"
+    "alias ll='ls -l' la=\"ls -la\"\n";
+
+typedef struct {
+    TSParser *parser;
+    double factor;
+    double slack_seconds;
+    double reference_seconds_per_byte;
+} Budget;
+
+static double parse_seconds(TSParser *parser, const char *source,
+                            uint32_t length) {
+    double start = now_seconds();
+    TSTree *tree = ts_parser_parse_string(parser, NULL, source, length);
+    double elapsed = now_seconds() - start;
+    ts_tree_delete(tree);
+    return elapsed;
+}
+
+static double budget_seconds(const Budget *budget, uint32_t length) {
+    return budget->slack_seconds +
+           budget->factor * budget->reference_seconds_per_byte * length;
+}
+
+// The fastest of up to RUNS parses, stopping at the first within budget
+static double measure(const Budget *budget, const char *source,
+                      uint32_t length) {
+    double best = 0;
+    for (int run = 0; run < RUNS; run++) {
+        double seconds = parse_seconds(budget->parser, source, length);
+        if (run == 0 || seconds < best) {
+            best = seconds;
+        }
+        if (best <= budget_seconds(budget, length)) {
+            break;
+        }
+    }
+    return best;
+}
+
+static bool init_budget(Budget *budget, double factor, double slack_ms) {
+    budget->parser = ts_parser_new();
+    if (!ts_parser_set_language(budget->parser, tree_sitter_zsh())) {
+        fprintf(stderr, "incompatible tree-sitter runtime\n");
+        return false;
+    }
+    budget->factor = factor;
+    budget->slack_seconds = slack_ms * 1e-3;
+
+    size_t size = sizeof(reference) - 1;
+    size_t copies = REFERENCE_SIZE / size + 1;
+    char *source = malloc(copies * size);
+    for (size_t i = 0; i < copies; i++) {
+        memcpy(source + i * size, reference, size);
+    }
+    uint32_t length = (uint32_t)(copies * size);
+    double best = 0;
+    for (int run = 0; run < RUNS; run++) {
+        double seconds = parse_seconds(budget->parser, source, length);
+        if (run == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+    free(source);
+    budget->reference_seconds_per_byte = best / length;
+    return true;
+}
+
+#ifdef TREE_SITTER_ZSH_LIBFUZZER
+
+static Budget budget;
+
+static double env_double(const char *name, double fallback) {
+    const char *value = getenv(name);
+    return value && *value ? strtod(value, NULL) : fallback;
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv) {
+    (void)argc;
+    (void)argv;
+    if (!init_budget(&budget,
+                     env_double("TREE_SITTER_ZSH_FUZZ_FACTOR", DEFAULT_FACTOR),
+                     env_double("TREE_SITTER_ZSH_FUZZ_SLACK_MS",
+                                DEFAULT_SLACK_MS))) {
+        abort();
+    }
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size > UINT32_MAX) {
+        return -1;
+    }
+    uint32_t length = (uint32_t)size;
+    double seconds = measure(&budget, (const char *)data, length);
+    double limit = budget_seconds(&budget, length);
+    if (seconds > limit) {
+        fprintf(stderr,
+                "input over the linear budget: %u bytes parsed in %.3f ms, "
+                "budget %.3f ms (%.1f ns per byte, reference %.1f)\n",
+                length, seconds * 1e3, limit * 1e3,
+                length ? seconds * 1e9 / length : 0,
+                budget.reference_seconds_per_byte * 1e9);
+        abort();
+    }
+    return 0;
+}
+
+#else
+
+int main(int argc, char **argv) {
+    static const char usage[] = "usage: %s [-f factor] [-m slack_ms] FILE...\n";
+    double factor = DEFAULT_FACTOR;
+    double slack_ms = DEFAULT_SLACK_MS;
+    int first_file = argc;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            factor = strtod(argv[++i], NULL);
+        } else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+            slack_ms = strtod(argv[++i], NULL);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, usage, argv[0]);
+            return 1;
+        } else {
+            first_file = i;
+            break;
+        }
+    }
+    if (first_file == argc || factor <= 0 || slack_ms < 0) {
+        fprintf(stderr, usage, argv[0]);
+        return 1;
+    }
+
+    Budget budget;
+    if (!init_budget(&budget, factor, slack_ms)) {
+        return 1;
+    }
+    printf("reference_ns_per_byte: %.2f\n",
+           budget.reference_seconds_per_byte * 1e9);
+    printf("factor: %.1f\n", factor);
+    printf("slack_ms: %.1f\n", slack_ms);
+
+    uint32_t slow = 0;
+    bool ok = true;
+    for (int i = first_file; i < argc; i++) {
+        uint32_t length = 0;
+        char *source = read_file(argv[i], &length);
+        if (!source) {
+            fprintf(stderr, "cannot read %s\n", argv[i]);
+            ok = false;
+            continue;
+        }
+        double seconds = measure(&budget, source, length);
+        double limit = budget_seconds(&budget, length);
+        free(source);
+        bool over = seconds > limit;
+        slow += over;
+        printf("file: %s bytes=%u ms=%.3f budget_ms=%.3f budget_used=%.2f%s\n",
+               argv[i], length, seconds * 1e3, limit * 1e3, seconds / limit,
+               over ? " slow" : "");
+    }
+    printf("slow_files: %u\n", slow);
+    ts_parser_delete(budget.parser);
+    return ok && slow == 0 ? 0 : 1;
+}
+
+#endif
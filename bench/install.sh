@@ -0,0 +1,1286 @@
+#!/usr/bin/env zsh
+# Generated installer: writes service configuration with heredocs
+
+set -e
+
+install_api0() {
+  mkdir -p /etc/api0
+  cat <<'EOF' > /etc/api0/api0.conf
+STATE_DIR=api0-97227
+SOCKET=api0-90498
+SCANNER_BENCH_E=api0-69473
+SERVICE_NAME=api0-61030
+SSL_KEY=api0-85062
+SERVICE_NAME=api0-20558
+SCANNER_BENCH=api0-48731
+ENV=api0-32318
+EOF_MARKER=api0-71271
+SCANNER_BENCH=api0-75227
+SSL_KEY=api0-1718
+SSL_KEY=api0-53497
+STATE_DIR=api0-23865
+EOF_MARKER=api0-20919
+SCANNER_BENCH=api0-18188
+SCANNER_BENCH_EOX=api0-80930
+ENV=api0-16606
+SSL_CERT=api0-232
+SERVICE_NAME=api0-27453
+SSL_KEY=api0-21739
+SSL_CERT=api0-37919
+SOCKET=api0-26068
+LISTEN=api0-88844
+SCANNER_BENCH_E=api0-26840
+SSL_CERT=api0-90523
+SSL_KEY=api0-50229
+STATE_DIR=api0-2827
+SOCKET=api0-54382
+SSL_CERT=api0-19097
+STATE_DIR=api0-8537
+SOCKET=api0-39499
+SCANNER_BENCH_EOX=api0-76826
+SERVICE_NAME=api0-78116
+SCANNER_BENCH_E=api0-92756
+EOF
+  cat <<-SQL | psql api0
+	SELECT id, name FROM api0_jobs WHERE state = 'queued';
+	CREATE INDEX IF NOT EXISTS api0_idx ON api0_jobs (state);
+	CREATE INDEX IF NOT EXISTS api0_idx ON api0_jobs (state);
+	CREATE INDEX IF NOT EXISTS api0_idx ON api0_jobs (state);
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS api0_idx ON api0_jobs (state);
+	SET search_path TO api0;
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	SET search_path TO api0;
+	SQL
+  cat <<EOF > /etc/systemd/system/api0.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} api0
+
+[Service]
+ExecStart=/usr/bin/api0 --config /etc/api0/api0.conf
+User=$USER
+EOF
+}
+
+install_worker1() {
+  mkdir -p /etc/worker1
+  cat <<'EOF' > /etc/worker1/worker1.conf
+STATE_DIR=worker1-2997
+SOCKET=worker1-52991
+SERVICE_NAME=worker1-71967
+EOF_MARKER=worker1-47996
+EOF_MARKER=worker1-75827
+SERVICE_NAME=worker1-59352
+SERVICE_NAME=worker1-92767
+SSL_CERT=worker1-81751
+SSL_KEY=worker1-15600
+SSL_KEY=worker1-60582
+SOCKET=worker1-67173
+SOCKET=worker1-68773
+STATE_DIR=worker1-60666
+SCANNER_BENCH=worker1-77301
+SOCKET=worker1-38779
+SERVICE_NAME=worker1-56751
+EOF
+  cat <<-SQL | psql worker1
+	SET search_path TO worker1;
+	CREATE INDEX IF NOT EXISTS worker1_idx ON worker1_jobs (state);
+	CREATE INDEX IF NOT EXISTS worker1_idx ON worker1_jobs (state);
+	SET search_path TO worker1;
+	CREATE INDEX IF NOT EXISTS worker1_idx ON worker1_jobs (state);
+	CREATE INDEX IF NOT EXISTS worker1_idx ON worker1_jobs (state);
+	SQL
+  cat <<EOF > /etc/systemd/system/worker1.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} worker1
+
+[Service]
+ExecStart=/usr/bin/worker1 --config /etc/worker1/worker1.conf
+User=$USER
+EOF
+}
+
+install_scheduler2() {
+  mkdir -p /etc/scheduler2
+  cat <<'EOF' > /etc/scheduler2/scheduler2.conf
+LISTEN=scheduler2-12068
+STATE_DIR=scheduler2-89910
+SOCKET=scheduler2-40130
+SSL_CERT=scheduler2-10249
+SCANNER_BENCH_E=scheduler2-19512
+STATE_DIR=scheduler2-63411
+SSL_CERT=scheduler2-94388
+SERVICE_NAME=scheduler2-10611
+SCANNER_BENCH_EOX=scheduler2-69930
+EOF_MARKER=scheduler2-4171
+SSL_KEY=scheduler2-97066
+SCANNER_BENCH_EOX=scheduler2-45066
+STATE_DIR=scheduler2-59724
+SCANNER_BENCH_E=scheduler2-55280
+SSL_CERT=scheduler2-7301
+SCANNER_BENCH_E=scheduler2-4288
+ENV=scheduler2-43802
+SSL_KEY=scheduler2-17114
+SCANNER_BENCH_EOX=scheduler2-17403
+SCANNER_BENCH_E=scheduler2-54240
+SCANNER_BENCH=scheduler2-22127
+EOF_MARKER=scheduler2-48889
+SSL_CERT=scheduler2-7703
+EOF_MARKER=scheduler2-38641
+SSL_CERT=scheduler2-59395
+SCANNER_BENCH_EOX=scheduler2-22189
+LISTEN=scheduler2-59446
+ENV=scheduler2-90287
+SOCKET=scheduler2-62789
+STATE_DIR=scheduler2-38144
+ENV=scheduler2-52925
+SSL_CERT=scheduler2-14753
+EOF_MARKER=scheduler2-69697
+SSL_CERT=scheduler2-82177
+ENV=scheduler2-44365
+SSL_CERT=scheduler2-11683
+ENV=scheduler2-35692
+EOF
+  cat <<-SQL | psql scheduler2
+	CREATE INDEX IF NOT EXISTS scheduler2_idx ON scheduler2_jobs (state);
+	SELECT id, name FROM scheduler2_jobs WHERE state = 'queued';
+	CREATE INDEX IF NOT EXISTS scheduler2_idx ON scheduler2_jobs (state);
+	SELECT id, name FROM scheduler2_jobs WHERE state = 'queued';
+	CREATE INDEX IF NOT EXISTS scheduler2_idx ON scheduler2_jobs (state);
+	CREATE INDEX IF NOT EXISTS scheduler2_idx ON scheduler2_jobs (state);
+	CREATE INDEX IF NOT EXISTS scheduler2_idx ON scheduler2_jobs (state);
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS scheduler2_idx ON scheduler2_jobs (state);
+	CREATE INDEX IF NOT EXISTS scheduler2_idx ON scheduler2_jobs (state);
+	CREATE INDEX IF NOT EXISTS scheduler2_idx ON scheduler2_jobs (state);
+	SET search_path TO scheduler2;
+	SELECT id, name FROM scheduler2_jobs WHERE state = 'queued';
+	SQL
+  cat <<EOF > /etc/systemd/system/scheduler2.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} scheduler2
+
+[Service]
+ExecStart=/usr/bin/scheduler2 --config /etc/scheduler2/scheduler2.conf
+User=$USER
+EOF
+}
+
+install_gateway3() {
+  mkdir -p /etc/gateway3
+  cat <<'EOF' > /etc/gateway3/gateway3.conf
+LISTEN=gateway3-32858
+SOCKET=gateway3-88033
+STATE_DIR=gateway3-60678
+STATE_DIR=gateway3-65581
+SCANNER_BENCH_E=gateway3-88295
+SOCKET=gateway3-45597
+STATE_DIR=gateway3-84418
+SOCKET=gateway3-96708
+EOF_MARKER=gateway3-45881
+SSL_CERT=gateway3-90221
+ENV=gateway3-47746
+SOCKET=gateway3-67913
+SSL_CERT=gateway3-69381
+SSL_CERT=gateway3-26037
+SOCKET=gateway3-62552
+STATE_DIR=gateway3-90626
+SCANNER_BENCH=gateway3-94330
+SCANNER_BENCH_E=gateway3-95728
+EOF_MARKER=gateway3-22521
+SCANNER_BENCH_EOX=gateway3-76132
+LISTEN=gateway3-87235
+EOF_MARKER=gateway3-39671
+SCANNER_BENCH_EOX=gateway3-72510
+SCANNER_BENCH_E=gateway3-35481
+SERVICE_NAME=gateway3-25637
+SSL_CERT=gateway3-76866
+ENV=gateway3-81798
+SCANNER_BENCH_E=gateway3-23690
+SSL_KEY=gateway3-99483
+SCANNER_BENCH_E=gateway3-23662
+EOF
+  cat <<-SQL | psql gateway3
+	SELECT id, name FROM gateway3_jobs WHERE state = 'queued';
+	SQLITE_COMPAT = off;
+	SET search_path TO gateway3;
+	SET search_path TO gateway3;
+	SELECT id, name FROM gateway3_jobs WHERE state = 'queued';
+	SET search_path TO gateway3;
+	SELECT id, name FROM gateway3_jobs WHERE state = 'queued';
+	CREATE INDEX IF NOT EXISTS gateway3_idx ON gateway3_jobs (state);
+	SET search_path TO gateway3;
+	SQLITE_COMPAT = off;
+	SET search_path TO gateway3;
+	SELECT id, name FROM gateway3_jobs WHERE state = 'queued';
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS gateway3_idx ON gateway3_jobs (state);
+	SQL
+  cat <<EOF > /etc/systemd/system/gateway3.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} gateway3
+
+[Service]
+ExecStart=/usr/bin/gateway3 --config /etc/gateway3/gateway3.conf
+User=$USER
+EOF
+}
+
+install_metrics4() {
+  mkdir -p /etc/metrics4
+  cat <<'EOF' > /etc/metrics4/metrics4.conf
+SCANNER_BENCH_E=metrics4-80189
+SCANNER_BENCH=metrics4-77354
+SSL_KEY=metrics4-31175
+SOCKET=metrics4-86
+SOCKET=metrics4-53133
+STATE_DIR=metrics4-53745
+SCANNER_BENCH=metrics4-90289
+LISTEN=metrics4-49005
+SERVICE_NAME=metrics4-72080
+SCANNER_BENCH_EOX=metrics4-39502
+SCANNER_BENCH=metrics4-38703
+LISTEN=metrics4-67193
+SOCKET=metrics4-76139
+STATE_DIR=metrics4-46087
+SSL_CERT=metrics4-54932
+EOF_MARKER=metrics4-73914
+SCANNER_BENCH_E=metrics4-70567
+SOCKET=metrics4-61272
+SSL_CERT=metrics4-20548
+SCANNER_BENCH_EOX=metrics4-50167
+SCANNER_BENCH_EOX=metrics4-62525
+SSL_KEY=metrics4-17430
+SCANNER_BENCH_EOX=metrics4-11905
+SOCKET=metrics4-86724
+SERVICE_NAME=metrics4-50050
+SCANNER_BENCH=metrics4-42734
+SCANNER_BENCH_EOX=metrics4-80631
+EOF
+  cat <<-SQL | psql metrics4
+	SET search_path TO metrics4;
+	CREATE INDEX IF NOT EXISTS metrics4_idx ON metrics4_jobs (state);
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	SET search_path TO metrics4;
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS metrics4_idx ON metrics4_jobs (state);
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	SET search_path TO metrics4;
+	CREATE INDEX IF NOT EXISTS metrics4_idx ON metrics4_jobs (state);
+	SQL
+  cat <<EOF > /etc/systemd/system/metrics4.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} metrics4
+
+[Service]
+ExecStart=/usr/bin/metrics4 --config /etc/metrics4/metrics4.conf
+User=$USER
+EOF
+}
+
+install_search5() {
+  mkdir -p /etc/search5
+  cat <<'EOF' > /etc/search5/search5.conf
+STATE_DIR=search5-65051
+STATE_DIR=search5-54459
+SERVICE_NAME=search5-41831
+STATE_DIR=search5-64455
+STATE_DIR=search5-18781
+ENV=search5-3116
+SCANNER_BENCH=search5-86515
+SCANNER_BENCH_EOX=search5-58126
+SSL_KEY=search5-38417
+SERVICE_NAME=search5-17883
+EOF_MARKER=search5-1730
+ENV=search5-69804
+LISTEN=search5-35885
+SSL_KEY=search5-62164
+SERVICE_NAME=search5-32199
+ENV=search5-35086
+SSL_CERT=search5-94562
+STATE_DIR=search5-38428
+ENV=search5-79696
+ENV=search5-67924
+SCANNER_BENCH_E=search5-79148
+SCANNER_BENCH=search5-2119
+SSL_CERT=search5-39412
+STATE_DIR=search5-69926
+SOCKET=search5-80422
+STATE_DIR=search5-95849
+LISTEN=search5-3488
+ENV=search5-45844
+SOCKET=search5-89359
+SCANNER_BENCH_EOX=search5-17364
+SERVICE_NAME=search5-371
+STATE_DIR=search5-72512
+ENV=search5-89880
+SCANNER_BENCH=search5-90101
+LISTEN=search5-25058
+SERVICE_NAME=search5-56317
+EOF_MARKER=search5-77973
+SCANNER_BENCH_EOX=search5-90310
+EOF
+  cat <<-SQL | psql search5
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	SET search_path TO search5;
+	CREATE INDEX IF NOT EXISTS search5_idx ON search5_jobs (state);
+	SQLITE_COMPAT = off;
+	SELECT id, name FROM search5_jobs WHERE state = 'queued';
+	CREATE INDEX IF NOT EXISTS search5_idx ON search5_jobs (state);
+	SELECT id, name FROM search5_jobs WHERE state = 'queued';
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS search5_idx ON search5_jobs (state);
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS search5_idx ON search5_jobs (state);
+	SET search_path TO search5;
+	SQL
+  cat <<EOF > /etc/systemd/system/search5.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} search5
+
+[Service]
+ExecStart=/usr/bin/search5 --config /etc/search5/search5.conf
+User=$USER
+EOF
+}
+
+install_cache6() {
+  mkdir -p /etc/cache6
+  cat <<'EOF' > /etc/cache6/cache6.conf
+ENV=cache6-91125
+LISTEN=cache6-65232
+SOCKET=cache6-70509
+SSL_CERT=cache6-55779
+SCANNER_BENCH_EOX=cache6-70963
+SERVICE_NAME=cache6-8967
+SSL_KEY=cache6-35023
+SCANNER_BENCH=cache6-8246
+SCANNER_BENCH_E=cache6-3349
+SOCKET=cache6-94712
+EOF_MARKER=cache6-9005
+EOF_MARKER=cache6-91913
+ENV=cache6-6408
+SCANNER_BENCH=cache6-16037
+SSL_KEY=cache6-80551
+SCANNER_BENCH_E=cache6-14569
+SSL_CERT=cache6-38337
+ENV=cache6-19625
+SSL_CERT=cache6-80034
+SSL_CERT=cache6-54255
+EOF
+  cat <<-SQL | psql cache6
+	SELECT id, name FROM cache6_jobs WHERE state = 'queued';
+	SET search_path TO cache6;
+	SELECT id, name FROM cache6_jobs WHERE state = 'queued';
+	SELECT id, name FROM cache6_jobs WHERE state = 'queued';
+	SQLITE_COMPAT = off;
+	SELECT id, name FROM cache6_jobs WHERE state = 'queued';
+	CREATE INDEX IF NOT EXISTS cache6_idx ON cache6_jobs (state);
+	SQL
+  cat <<EOF > /etc/systemd/system/cache6.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} cache6
+
+[Service]
+ExecStart=/usr/bin/cache6 --config /etc/cache6/cache6.conf
+User=$USER
+EOF
+}
+
+install_mailer7() {
+  mkdir -p /etc/mailer7
+  cat <<'EOF' > /etc/mailer7/mailer7.conf
+SCANNER_BENCH_EOX=mailer7-75399
+SCANNER_BENCH=mailer7-97299
+EOF_MARKER=mailer7-81752
+SSL_CERT=mailer7-1306
+EOF_MARKER=mailer7-11984
+SOCKET=mailer7-89846
+SCANNER_BENCH_EOX=mailer7-64152
+ENV=mailer7-46321
+SCANNER_BENCH_E=mailer7-49046
+SERVICE_NAME=mailer7-18118
+STATE_DIR=mailer7-19806
+SCANNER_BENCH_EOX=mailer7-82751
+SCANNER_BENCH_E=mailer7-66301
+STATE_DIR=mailer7-72730
+LISTEN=mailer7-81379
+SSL_KEY=mailer7-34504
+EOF
+  cat <<-SQL | psql mailer7
+	SET search_path TO mailer7;
+	CREATE INDEX IF NOT EXISTS mailer7_idx ON mailer7_jobs (state);
+	CREATE INDEX IF NOT EXISTS mailer7_idx ON mailer7_jobs (state);
+	SET search_path TO mailer7;
+	SET search_path TO mailer7;
+	CREATE INDEX IF NOT EXISTS mailer7_idx ON mailer7_jobs (state);
+	SQL
+  cat <<EOF > /etc/systemd/system/mailer7.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} mailer7
+
+[Service]
+ExecStart=/usr/bin/mailer7 --config /etc/mailer7/mailer7.conf
+User=$USER
+EOF
+}
+
+install_api8() {
+  mkdir -p /etc/api8
+  cat <<'EOF' > /etc/api8/api8.conf
+EOF_MARKER=api8-23503
+SSL_CERT=api8-93493
+SERVICE_NAME=api8-85853
+SOCKET=api8-11173
+SCANNER_BENCH_EOX=api8-87549
+SERVICE_NAME=api8-11950
+SCANNER_BENCH=api8-66383
+SCANNER_BENCH_EOX=api8-59441
+SSL_KEY=api8-51098
+ENV=api8-62975
+SOCKET=api8-14099
+LISTEN=api8-3861
+LISTEN=api8-95028
+EOF_MARKER=api8-7033
+SSL_CERT=api8-56273
+SCANNER_BENCH_E=api8-29240
+SCANNER_BENCH=api8-10980
+SCANNER_BENCH_E=api8-64414
+SSL_KEY=api8-18319
+SCANNER_BENCH_EOX=api8-49265
+SOCKET=api8-30804
+STATE_DIR=api8-43681
+SCANNER_BENCH_EOX=api8-92448
+SOCKET=api8-50560
+EOF_MARKER=api8-17881
+SOCKET=api8-84920
+STATE_DIR=api8-82751
+EOF_MARKER=api8-47476
+LISTEN=api8-4764
+EOF
+  cat <<-SQL | psql api8
+	SET search_path TO api8;
+	SET search_path TO api8;
+	SQLITE_COMPAT = off;
+	SELECT id, name FROM api8_jobs WHERE state = 'queued';
+	SELECT id, name FROM api8_jobs WHERE state = 'queued';
+	SELECT id, name FROM api8_jobs WHERE state = 'queued';
+	SELECT id, name FROM api8_jobs WHERE state = 'queued';
+	SET search_path TO api8;
+	SET search_path TO api8;
+	SET search_path TO api8;
+	SELECT id, name FROM api8_jobs WHERE state = 'queued';
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS api8_idx ON api8_jobs (state);
+	SQL
+  cat <<EOF > /etc/systemd/system/api8.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} api8
+
+[Service]
+ExecStart=/usr/bin/api8 --config /etc/api8/api8.conf
+User=$USER
+EOF
+}
+
+install_worker9() {
+  mkdir -p /etc/worker9
+  cat <<'EOF' > /etc/worker9/worker9.conf
+EOF_MARKER=worker9-61628
+STATE_DIR=worker9-81194
+EOF_MARKER=worker9-42370
+ENV=worker9-60541
+SCANNER_BENCH=worker9-25113
+SSL_CERT=worker9-85637
+SSL_CERT=worker9-9331
+SOCKET=worker9-50548
+ENV=worker9-19937
+LISTEN=worker9-33301
+SCANNER_BENCH=worker9-36363
+SSL_CERT=worker9-98352
+STATE_DIR=worker9-88078
+SSL_KEY=worker9-4345
+ENV=worker9-4206
+EOF
+  cat <<-SQL | psql worker9
+	CREATE INDEX IF NOT EXISTS worker9_idx ON worker9_jobs (state);
+	CREATE INDEX IF NOT EXISTS worker9_idx ON worker9_jobs (state);
+	SELECT id, name FROM worker9_jobs WHERE state = 'queued';
+	SELECT id, name FROM worker9_jobs WHERE state = 'queued';
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	SET search_path TO worker9;
+	SELECT id, name FROM worker9_jobs WHERE state = 'queued';
+	CREATE INDEX IF NOT EXISTS worker9_idx ON worker9_jobs (state);
+	CREATE INDEX IF NOT EXISTS worker9_idx ON worker9_jobs (state);
+	SQL
+  cat <<EOF > /etc/systemd/system/worker9.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} worker9
+
+[Service]
+ExecStart=/usr/bin/worker9 --config /etc/worker9/worker9.conf
+User=$USER
+EOF
+}
+
+install_scheduler10() {
+  mkdir -p /etc/scheduler10
+  cat <<'EOF' > /etc/scheduler10/scheduler10.conf
+SCANNER_BENCH_E=scheduler10-31450
+SSL_CERT=scheduler10-4395
+SSL_KEY=scheduler10-93691
+SERVICE_NAME=scheduler10-75329
+SSL_KEY=scheduler10-86044
+SCANNER_BENCH=scheduler10-80947
+EOF_MARKER=scheduler10-92630
+SOCKET=scheduler10-89197
+STATE_DIR=scheduler10-24179
+ENV=scheduler10-47377
+STATE_DIR=scheduler10-8765
+ENV=scheduler10-21411
+SSL_KEY=scheduler10-23022
+SCANNER_BENCH_E=scheduler10-27363
+SERVICE_NAME=scheduler10-84655
+SCANNER_BENCH_EOX=scheduler10-56445
+STATE_DIR=scheduler10-822
+ENV=scheduler10-7977
+ENV=scheduler10-89302
+EOF_MARKER=scheduler10-22250
+SERVICE_NAME=scheduler10-4360
+LISTEN=scheduler10-68018
+SCANNER_BENCH_EOX=scheduler10-45876
+SCANNER_BENCH=scheduler10-93917
+SCANNER_BENCH=scheduler10-31063
+ENV=scheduler10-12051
+ENV=scheduler10-7046
+SCANNER_BENCH_E=scheduler10-31911
+SCANNER_BENCH_E=scheduler10-6613
+EOF
+  cat <<-SQL | psql scheduler10
+	SQLITE_COMPAT = off;
+	SELECT id, name FROM scheduler10_jobs WHERE state = 'queued';
+	SELECT id, name FROM scheduler10_jobs WHERE state = 'queued';
+	CREATE INDEX IF NOT EXISTS scheduler10_idx ON scheduler10_jobs (state);
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS scheduler10_idx ON scheduler10_jobs (state);
+	SELECT id, name FROM scheduler10_jobs WHERE state = 'queued';
+	SELECT id, name FROM scheduler10_jobs WHERE state = 'queued';
+	SET search_path TO scheduler10;
+	SET search_path TO scheduler10;
+	SQLITE_COMPAT = off;
+	SQL
+  cat <<EOF > /etc/systemd/system/scheduler10.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} scheduler10
+
+[Service]
+ExecStart=/usr/bin/scheduler10 --config /etc/scheduler10/scheduler10.conf
+User=$USER
+EOF
+}
+
+install_gateway11() {
+  mkdir -p /etc/gateway11
+  cat <<'EOF' > /etc/gateway11/gateway11.conf
+LISTEN=gateway11-30634
+SCANNER_BENCH=gateway11-41141
+SCANNER_BENCH=gateway11-11379
+LISTEN=gateway11-21225
+SCANNER_BENCH_EOX=gateway11-9879
+SSL_KEY=gateway11-81913
+SERVICE_NAME=gateway11-57830
+LISTEN=gateway11-46873
+ENV=gateway11-55467
+SCANNER_BENCH_EOX=gateway11-49365
+LISTEN=gateway11-81933
+SSL_CERT=gateway11-95110
+SERVICE_NAME=gateway11-99113
+STATE_DIR=gateway11-90256
+ENV=gateway11-29356
+LISTEN=gateway11-15163
+SSL_CERT=gateway11-40857
+ENV=gateway11-11486
+STATE_DIR=gateway11-52769
+SOCKET=gateway11-17389
+SSL_CERT=gateway11-70354
+EOF
+  cat <<-SQL | psql gateway11
+	SQLITE_COMPAT = off;
+	SET search_path TO gateway11;
+	SELECT id, name FROM gateway11_jobs WHERE state = 'queued';
+	SQLITE_COMPAT = off;
+	SET search_path TO gateway11;
+	CREATE INDEX IF NOT EXISTS gateway11_idx ON gateway11_jobs (state);
+	SQL
+  cat <<EOF > /etc/systemd/system/gateway11.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} gateway11
+
+[Service]
+ExecStart=/usr/bin/gateway11 --config /etc/gateway11/gateway11.conf
+User=$USER
+EOF
+}
+
+install_metrics12() {
+  mkdir -p /etc/metrics12
+  cat <<'EOF' > /etc/metrics12/metrics12.conf
+ENV=metrics12-91829
+SSL_KEY=metrics12-6295
+SSL_KEY=metrics12-37488
+SOCKET=metrics12-12914
+SCANNER_BENCH=metrics12-55125
+SOCKET=metrics12-49789
+LISTEN=metrics12-9
+STATE_DIR=metrics12-85733
+SSL_CERT=metrics12-75330
+SERVICE_NAME=metrics12-57957
+SSL_CERT=metrics12-90121
+SCANNER_BENCH_E=metrics12-2452
+SERVICE_NAME=metrics12-91904
+EOF_MARKER=metrics12-35087
+SCANNER_BENCH=metrics12-50122
+LISTEN=metrics12-17071
+EOF
+  cat <<-SQL | psql metrics12
+	SELECT id, name FROM metrics12_jobs WHERE state = 'queued';
+	CREATE INDEX IF NOT EXISTS metrics12_idx ON metrics12_jobs (state);
+	SET search_path TO metrics12;
+	SET search_path TO metrics12;
+	CREATE INDEX IF NOT EXISTS metrics12_idx ON metrics12_jobs (state);
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS metrics12_idx ON metrics12_jobs (state);
+	CREATE INDEX IF NOT EXISTS metrics12_idx ON metrics12_jobs (state);
+	SELECT id, name FROM metrics12_jobs WHERE state = 'queued';
+	SELECT id, name FROM metrics12_jobs WHERE state = 'queued';
+	SQL
+  cat <<EOF > /etc/systemd/system/metrics12.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} metrics12
+
+[Service]
+ExecStart=/usr/bin/metrics12 --config /etc/metrics12/metrics12.conf
+User=$USER
+EOF
+}
+
+install_search13() {
+  mkdir -p /etc/search13
+  cat <<'EOF' > /etc/search13/search13.conf
+LISTEN=search13-3655
+SERVICE_NAME=search13-15946
+SERVICE_NAME=search13-17054
+SOCKET=search13-57141
+STATE_DIR=search13-80216
+SERVICE_NAME=search13-30290
+LISTEN=search13-56217
+SSL_CERT=search13-47501
+SSL_KEY=search13-43302
+SOCKET=search13-1631
+SSL_CERT=search13-76601
+SCANNER_BENCH_EOX=search13-21386
+SCANNER_BENCH=search13-35148
+LISTEN=search13-79419
+SSL_CERT=search13-82649
+SSL_CERT=search13-58486
+EOF_MARKER=search13-56289
+SCANNER_BENCH=search13-43710
+SOCKET=search13-58435
+SSL_KEY=search13-60423
+SCANNER_BENCH_EOX=search13-56905
+SSL_CERT=search13-57858
+SERVICE_NAME=search13-87553
+SSL_CERT=search13-69809
+ENV=search13-64411
+SCANNER_BENCH_EOX=search13-211
+SCANNER_BENCH=search13-16630
+EOF_MARKER=search13-89849
+SERVICE_NAME=search13-27204
+SERVICE_NAME=search13-4308
+SCANNER_BENCH_EOX=search13-30910
+ENV=search13-92413
+EOF
+  cat <<-SQL | psql search13
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	SET search_path TO search13;
+	SET search_path TO search13;
+	CREATE INDEX IF NOT EXISTS search13_idx ON search13_jobs (state);
+	SET search_path TO search13;
+	CREATE INDEX IF NOT EXISTS search13_idx ON search13_jobs (state);
+	CREATE INDEX IF NOT EXISTS search13_idx ON search13_jobs (state);
+	SET search_path TO search13;
+	CREATE INDEX IF NOT EXISTS search13_idx ON search13_jobs (state);
+	SQL
+  cat <<EOF > /etc/systemd/system/search13.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} search13
+
+[Service]
+ExecStart=/usr/bin/search13 --config /etc/search13/search13.conf
+User=$USER
+EOF
+}
+
+install_cache14() {
+  mkdir -p /etc/cache14
+  cat <<'EOF' > /etc/cache14/cache14.conf
+SSL_KEY=cache14-86918
+SERVICE_NAME=cache14-81022
+ENV=cache14-52541
+SOCKET=cache14-18750
+SSL_CERT=cache14-31238
+ENV=cache14-50013
+SERVICE_NAME=cache14-12290
+SSL_CERT=cache14-52034
+SCANNER_BENCH=cache14-98776
+STATE_DIR=cache14-26124
+SOCKET=cache14-62541
+SCANNER_BENCH_E=cache14-61622
+LISTEN=cache14-81671
+SCANNER_BENCH=cache14-26080
+EOF_MARKER=cache14-90265
+SERVICE_NAME=cache14-13570
+LISTEN=cache14-79342
+SCANNER_BENCH_EOX=cache14-81388
+SSL_CERT=cache14-50999
+SERVICE_NAME=cache14-41581
+SCANNER_BENCH_E=cache14-3545
+SCANNER_BENCH_EOX=cache14-40904
+LISTEN=cache14-50179
+LISTEN=cache14-62403
+LISTEN=cache14-92189
+EOF_MARKER=cache14-58949
+EOF
+  cat <<-SQL | psql cache14
+	SELECT id, name FROM cache14_jobs WHERE state = 'queued';
+	SET search_path TO cache14;
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS cache14_idx ON cache14_jobs (state);
+	SELECT id, name FROM cache14_jobs WHERE state = 'queued';
+	SET search_path TO cache14;
+	CREATE INDEX IF NOT EXISTS cache14_idx ON cache14_jobs (state);
+	CREATE INDEX IF NOT EXISTS cache14_idx ON cache14_jobs (state);
+	SELECT id, name FROM cache14_jobs WHERE state = 'queued';
+	SELECT id, name FROM cache14_jobs WHERE state = 'queued';
+	SELECT id, name FROM cache14_jobs WHERE state = 'queued';
+	CREATE INDEX IF NOT EXISTS cache14_idx ON cache14_jobs (state);
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS cache14_idx ON cache14_jobs (state);
+	SQL
+  cat <<EOF > /etc/systemd/system/cache14.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} cache14
+
+[Service]
+ExecStart=/usr/bin/cache14 --config /etc/cache14/cache14.conf
+User=$USER
+EOF
+}
+
+install_mailer15() {
+  mkdir -p /etc/mailer15
+  cat <<'EOF' > /etc/mailer15/mailer15.conf
+STATE_DIR=mailer15-93856
+SSL_KEY=mailer15-9441
+SERVICE_NAME=mailer15-98748
+SCANNER_BENCH=mailer15-87810
+STATE_DIR=mailer15-46058
+SCANNER_BENCH_EOX=mailer15-80082
+LISTEN=mailer15-27360
+ENV=mailer15-67723
+SCANNER_BENCH=mailer15-15868
+SSL_KEY=mailer15-44821
+LISTEN=mailer15-55519
+EOF_MARKER=mailer15-387
+SCANNER_BENCH_E=mailer15-51139
+EOF_MARKER=mailer15-23348
+SCANNER_BENCH_E=mailer15-69249
+EOF
+  cat <<-SQL | psql mailer15
+	CREATE INDEX IF NOT EXISTS mailer15_idx ON mailer15_jobs (state);
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS mailer15_idx ON mailer15_jobs (state);
+	SELECT id, name FROM mailer15_jobs WHERE state = 'queued';
+	CREATE INDEX IF NOT EXISTS mailer15_idx ON mailer15_jobs (state);
+	SET search_path TO mailer15;
+	SELECT id, name FROM mailer15_jobs WHERE state = 'queued';
+	SET search_path TO mailer15;
+	SQL
+  cat <<EOF > /etc/systemd/system/mailer15.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} mailer15
+
+[Service]
+ExecStart=/usr/bin/mailer15 --config /etc/mailer15/mailer15.conf
+User=$USER
+EOF
+}
+
+install_api16() {
+  mkdir -p /etc/api16
+  cat <<'EOF' > /etc/api16/api16.conf
+STATE_DIR=api16-35083
+SCANNER_BENCH_EOX=api16-10215
+SSL_CERT=api16-10049
+SCANNER_BENCH_E=api16-54137
+SSL_CERT=api16-29445
+SCANNER_BENCH_E=api16-8216
+SCANNER_BENCH_EOX=api16-74172
+SCANNER_BENCH_E=api16-83877
+LISTEN=api16-95425
+EOF_MARKER=api16-54637
+SSL_KEY=api16-55757
+ENV=api16-69306
+SCANNER_BENCH_EOX=api16-32026
+STATE_DIR=api16-54824
+STATE_DIR=api16-11065
+SCANNER_BENCH_EOX=api16-43345
+SSL_CERT=api16-55288
+SERVICE_NAME=api16-19552
+SCANNER_BENCH=api16-38752
+SCANNER_BENCH_EOX=api16-72746
+SCANNER_BENCH_EOX=api16-73842
+SSL_CERT=api16-56862
+SSL_KEY=api16-42736
+SCANNER_BENCH_EOX=api16-13410
+EOF
+  cat <<-SQL | psql api16
+	CREATE INDEX IF NOT EXISTS api16_idx ON api16_jobs (state);
+	SELECT id, name FROM api16_jobs WHERE state = 'queued';
+	SELECT id, name FROM api16_jobs WHERE state = 'queued';
+	SQLITE_COMPAT = off;
+	SET search_path TO api16;
+	SELECT id, name FROM api16_jobs WHERE state = 'queued';
+	CREATE INDEX IF NOT EXISTS api16_idx ON api16_jobs (state);
+	SET search_path TO api16;
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	SET search_path TO api16;
+	SQLITE_COMPAT = off;
+	SELECT id, name FROM api16_jobs WHERE state = 'queued';
+	SELECT id, name FROM api16_jobs WHERE state = 'queued';
+	SET search_path TO api16;
+	SQL
+  cat <<EOF > /etc/systemd/system/api16.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} api16
+
+[Service]
+ExecStart=/usr/bin/api16 --config /etc/api16/api16.conf
+User=$USER
+EOF
+}
+
+install_worker17() {
+  mkdir -p /etc/worker17
+  cat <<'EOF' > /etc/worker17/worker17.conf
+SSL_CERT=worker17-14627
+SCANNER_BENCH=worker17-44005
+SSL_CERT=worker17-48194
+SCANNER_BENCH_EOX=worker17-99669
+SCANNER_BENCH=worker17-75362
+ENV=worker17-96497
+SOCKET=worker17-23990
+LISTEN=worker17-76075
+SCANNER_BENCH_E=worker17-13542
+SOCKET=worker17-13484
+SCANNER_BENCH=worker17-25623
+SSL_KEY=worker17-42490
+SOCKET=worker17-22658
+ENV=worker17-89194
+SCANNER_BENCH=worker17-32224
+EOF_MARKER=worker17-71233
+ENV=worker17-49175
+SERVICE_NAME=worker17-15407
+SCANNER_BENCH_EOX=worker17-49074
+SSL_CERT=worker17-89617
+SERVICE_NAME=worker17-64947
+EOF_MARKER=worker17-44905
+SCANNER_BENCH=worker17-64315
+STATE_DIR=worker17-2075
+SCANNER_BENCH=worker17-62785
+SOCKET=worker17-98426
+SSL_KEY=worker17-45041
+EOF_MARKER=worker17-18562
+STATE_DIR=worker17-65373
+SCANNER_BENCH_E=worker17-91339
+SCANNER_BENCH=worker17-75455
+SCANNER_BENCH=worker17-38793
+EOF_MARKER=worker17-44164
+SCANNER_BENCH=worker17-68058
+EOF_MARKER=worker17-6605
+SSL_KEY=worker17-55149
+EOF
+  cat <<-SQL | psql worker17
+	CREATE INDEX IF NOT EXISTS worker17_idx ON worker17_jobs (state);
+	SELECT id, name FROM worker17_jobs WHERE state = 'queued';
+	SET search_path TO worker17;
+	CREATE INDEX IF NOT EXISTS worker17_idx ON worker17_jobs (state);
+	SELECT id, name FROM worker17_jobs WHERE state = 'queued';
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	SET search_path TO worker17;
+	SQL
+  cat <<EOF > /etc/systemd/system/worker17.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} worker17
+
+[Service]
+ExecStart=/usr/bin/worker17 --config /etc/worker17/worker17.conf
+User=$USER
+EOF
+}
+
+install_scheduler18() {
+  mkdir -p /etc/scheduler18
+  cat <<'EOF' > /etc/scheduler18/scheduler18.conf
+EOF_MARKER=scheduler18-32116
+SCANNER_BENCH=scheduler18-59305
+SOCKET=scheduler18-16910
+SCANNER_BENCH=scheduler18-671
+SSL_CERT=scheduler18-47322
+SERVICE_NAME=scheduler18-2791
+STATE_DIR=scheduler18-73705
+ENV=scheduler18-50176
+LISTEN=scheduler18-10277
+SERVICE_NAME=scheduler18-28650
+SSL_KEY=scheduler18-58018
+SERVICE_NAME=scheduler18-61851
+LISTEN=scheduler18-11186
+STATE_DIR=scheduler18-78426
+SCANNER_BENCH_E=scheduler18-61650
+LISTEN=scheduler18-2948
+SERVICE_NAME=scheduler18-20972
+EOF_MARKER=scheduler18-65558
+EOF_MARKER=scheduler18-77796
+SCANNER_BENCH_E=scheduler18-84558
+SCANNER_BENCH_EOX=scheduler18-83342
+SCANNER_BENCH_EOX=scheduler18-4725
+SSL_KEY=scheduler18-3122
+EOF_MARKER=scheduler18-94799
+EOF_MARKER=scheduler18-56668
+EOF_MARKER=scheduler18-1953
+SSL_CERT=scheduler18-44357
+SSL_CERT=scheduler18-39711
+SSL_KEY=scheduler18-55330
+SCANNER_BENCH=scheduler18-48430
+SSL_KEY=scheduler18-51587
+EOF_MARKER=scheduler18-24988
+EOF
+  cat <<-SQL | psql scheduler18
+	SET search_path TO scheduler18;
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS scheduler18_idx ON scheduler18_jobs (state);
+	CREATE INDEX IF NOT EXISTS scheduler18_idx ON scheduler18_jobs (state);
+	SELECT id, name FROM scheduler18_jobs WHERE state = 'queued';
+	SELECT id, name FROM scheduler18_jobs WHERE state = 'queued';
+	SET search_path TO scheduler18;
+	SQLITE_COMPAT = off;
+	SELECT id, name FROM scheduler18_jobs WHERE state = 'queued';
+	SQL
+  cat <<EOF > /etc/systemd/system/scheduler18.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} scheduler18
+
+[Service]
+ExecStart=/usr/bin/scheduler18 --config /etc/scheduler18/scheduler18.conf
+User=$USER
+EOF
+}
+
+install_gateway19() {
+  mkdir -p /etc/gateway19
+  cat <<'EOF' > /etc/gateway19/gateway19.conf
+SCANNER_BENCH_E=gateway19-49961
+SERVICE_NAME=gateway19-53683
+SSL_CERT=gateway19-25759
+SCANNER_BENCH_E=gateway19-2422
+ENV=gateway19-41636
+SCANNER_BENCH_EOX=gateway19-60046
+SSL_CERT=gateway19-61362
+SSL_KEY=gateway19-10126
+SOCKET=gateway19-81124
+SERVICE_NAME=gateway19-1884
+SSL_CERT=gateway19-56232
+SCANNER_BENCH=gateway19-34956
+SSL_CERT=gateway19-98812
+SCANNER_BENCH_E=gateway19-48882
+SOCKET=gateway19-28128
+SSL_CERT=gateway19-38506
+LISTEN=gateway19-92013
+EOF
+  cat <<-SQL | psql gateway19
+	SELECT id, name FROM gateway19_jobs WHERE state = 'queued';
+	CREATE INDEX IF NOT EXISTS gateway19_idx ON gateway19_jobs (state);
+	SELECT id, name FROM gateway19_jobs WHERE state = 'queued';
+	SELECT id, name FROM gateway19_jobs WHERE state = 'queued';
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS gateway19_idx ON gateway19_jobs (state);
+	CREATE INDEX IF NOT EXISTS gateway19_idx ON gateway19_jobs (state);
+	CREATE INDEX IF NOT EXISTS gateway19_idx ON gateway19_jobs (state);
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	SET search_path TO gateway19;
+	SET search_path TO gateway19;
+	CREATE INDEX IF NOT EXISTS gateway19_idx ON gateway19_jobs (state);
+	SQL
+  cat <<EOF > /etc/systemd/system/gateway19.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} gateway19
+
+[Service]
+ExecStart=/usr/bin/gateway19 --config /etc/gateway19/gateway19.conf
+User=$USER
+EOF
+}
+
+install_metrics20() {
+  mkdir -p /etc/metrics20
+  cat <<'EOF' > /etc/metrics20/metrics20.conf
+LISTEN=metrics20-1655
+EOF_MARKER=metrics20-17511
+SSL_KEY=metrics20-63065
+SCANNER_BENCH_E=metrics20-92505
+SERVICE_NAME=metrics20-1067
+SERVICE_NAME=metrics20-27698
+EOF_MARKER=metrics20-30464
+LISTEN=metrics20-93874
+SCANNER_BENCH_EOX=metrics20-30936
+STATE_DIR=metrics20-7347
+LISTEN=metrics20-31263
+SERVICE_NAME=metrics20-90734
+EOF_MARKER=metrics20-45318
+SERVICE_NAME=metrics20-73106
+STATE_DIR=metrics20-57616
+EOF
+  cat <<-SQL | psql metrics20
+	SELECT id, name FROM metrics20_jobs WHERE state = 'queued';
+	SELECT id, name FROM metrics20_jobs WHERE state = 'queued';
+	CREATE INDEX IF NOT EXISTS metrics20_idx ON metrics20_jobs (state);
+	CREATE INDEX IF NOT EXISTS metrics20_idx ON metrics20_jobs (state);
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS metrics20_idx ON metrics20_jobs (state);
+	SET search_path TO metrics20;
+	SELECT id, name FROM metrics20_jobs WHERE state = 'queued';
+	SQLITE_COMPAT = off;
+	SELECT id, name FROM metrics20_jobs WHERE state = 'queued';
+	SET search_path TO metrics20;
+	SQL
+  cat <<EOF > /etc/systemd/system/metrics20.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} metrics20
+
+[Service]
+ExecStart=/usr/bin/metrics20 --config /etc/metrics20/metrics20.conf
+User=$USER
+EOF
+}
+
+install_search21() {
+  mkdir -p /etc/search21
+  cat <<'EOF' > /etc/search21/search21.conf
+SCANNER_BENCH_EOX=search21-50953
+SCANNER_BENCH=search21-67293
+STATE_DIR=search21-72315
+SOCKET=search21-53570
+SSL_CERT=search21-59795
+SOCKET=search21-8278
+ENV=search21-502
+SCANNER_BENCH_EOX=search21-74017
+SSL_KEY=search21-74295
+ENV=search21-5532
+SERVICE_NAME=search21-97263
+SCANNER_BENCH=search21-15319
+SOCKET=search21-18846
+SOCKET=search21-44667
+STATE_DIR=search21-36142
+ENV=search21-18854
+SCANNER_BENCH=search21-34354
+STATE_DIR=search21-3252
+SCANNER_BENCH_E=search21-33072
+EOF_MARKER=search21-21785
+SCANNER_BENCH_E=search21-32206
+STATE_DIR=search21-77596
+ENV=search21-23190
+SCANNER_BENCH_EOX=search21-17996
+SCANNER_BENCH_EOX=search21-6809
+SOCKET=search21-73560
+SCANNER_BENCH=search21-1264
+ENV=search21-5674
+SCANNER_BENCH_EOX=search21-64798
+SCANNER_BENCH_E=search21-85143
+SERVICE_NAME=search21-3408
+EOF
+  cat <<-SQL | psql search21
+	SQLITE_COMPAT = off;
+	SELECT id, name FROM search21_jobs WHERE state = 'queued';
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	SET search_path TO search21;
+	SELECT id, name FROM search21_jobs WHERE state = 'queued';
+	SELECT id, name FROM search21_jobs WHERE state = 'queued';
+	SELECT id, name FROM search21_jobs WHERE state = 'queued';
+	SELECT id, name FROM search21_jobs WHERE state = 'queued';
+	SELECT id, name FROM search21_jobs WHERE state = 'queued';
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS search21_idx ON search21_jobs (state);
+	SELECT id, name FROM search21_jobs WHERE state = 'queued';
+	CREATE INDEX IF NOT EXISTS search21_idx ON search21_jobs (state);
+	SQL
+  cat <<EOF > /etc/systemd/system/search21.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} search21
+
+[Service]
+ExecStart=/usr/bin/search21 --config /etc/search21/search21.conf
+User=$USER
+EOF
+}
+
+install_cache22() {
+  mkdir -p /etc/cache22
+  cat <<'EOF' > /etc/cache22/cache22.conf
+EOF_MARKER=cache22-98893
+STATE_DIR=cache22-33902
+ENV=cache22-39143
+STATE_DIR=cache22-196
+SOCKET=cache22-67600
+SCANNER_BENCH_E=cache22-65278
+ENV=cache22-49918
+SSL_CERT=cache22-85982
+SSL_KEY=cache22-34519
+SOCKET=cache22-80178
+SSL_KEY=cache22-59980
+SCANNER_BENCH=cache22-19688
+SOCKET=cache22-10370
+SCANNER_BENCH_E=cache22-55732
+ENV=cache22-81476
+LISTEN=cache22-85278
+EOF_MARKER=cache22-22912
+SSL_KEY=cache22-18193
+EOF
+  cat <<-SQL | psql cache22
+	SET search_path TO cache22;
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS cache22_idx ON cache22_jobs (state);
+	SELECT id, name FROM cache22_jobs WHERE state = 'queued';
+	SET search_path TO cache22;
+	SQLITE_COMPAT = off;
+	CREATE INDEX IF NOT EXISTS cache22_idx ON cache22_jobs (state);
+	SQLITE_COMPAT = off;
+	SET search_path TO cache22;
+	SET search_path TO cache22;
+	SET search_path TO cache22;
+	SQLITE_COMPAT = off;
+	SQL
+  cat <<EOF > /etc/systemd/system/cache22.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} cache22
+
+[Service]
+ExecStart=/usr/bin/cache22 --config /etc/cache22/cache22.conf
+User=$USER
+EOF
+}
+
+install_mailer23() {
+  mkdir -p /etc/mailer23
+  cat <<'EOF' > /etc/mailer23/mailer23.conf
+STATE_DIR=mailer23-41092
+STATE_DIR=mailer23-80865
+SCANNER_BENCH=mailer23-25700
+STATE_DIR=mailer23-55758
+SOCKET=mailer23-67666
+STATE_DIR=mailer23-63791
+SCANNER_BENCH_E=mailer23-92961
+SCANNER_BENCH_E=mailer23-11307
+SCANNER_BENCH=mailer23-90397
+SCANNER_BENCH=mailer23-44094
+SCANNER_BENCH=mailer23-13494
+SCANNER_BENCH_E=mailer23-37298
+SCANNER_BENCH_EOX=mailer23-23440
+SERVICE_NAME=mailer23-71182
+EOF_MARKER=mailer23-22572
+SCANNER_BENCH_E=mailer23-43868
+STATE_DIR=mailer23-13087
+EOF_MARKER=mailer23-43163
+SCANNER_BENCH=mailer23-40885
+SCANNER_BENCH=mailer23-38360
+SOCKET=mailer23-53809
+EOF_MARKER=mailer23-8220
+SCANNER_BENCH=mailer23-39508
+SCANNER_BENCH=mailer23-23611
+SERVICE_NAME=mailer23-12387
+LISTEN=mailer23-53295
+SCANNER_BENCH=mailer23-60525
+EOF_MARKER=mailer23-9399
+SSL_KEY=mailer23-55275
+SERVICE_NAME=mailer23-74052
+LISTEN=mailer23-38008
+SCANNER_BENCH_E=mailer23-14136
+EOF
+  cat <<-SQL | psql mailer23
+	CREATE INDEX IF NOT EXISTS mailer23_idx ON mailer23_jobs (state);
+	CREATE INDEX IF NOT EXISTS mailer23_idx ON mailer23_jobs (state);
+	SELECT id, name FROM mailer23_jobs WHERE state = 'queued';
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	SELECT id, name FROM mailer23_jobs WHERE state = 'queued';
+	SET search_path TO mailer23;
+	SET search_path TO mailer23;
+	SELECT id, name FROM mailer23_jobs WHERE state = 'queued';
+	SELECT id, name FROM mailer23_jobs WHERE state = 'queued';
+	SELECT id, name FROM mailer23_jobs WHERE state = 'queued';
+	SQLITE_COMPAT = off;
+	SQLITE_COMPAT = off;
+	SELECT id, name FROM mailer23_jobs WHERE state = 'queued';
+	CREATE INDEX IF NOT EXISTS mailer23_idx ON mailer23_jobs (state);
+	SQL
+  cat <<EOF > /etc/systemd/system/mailer23.service
+[Unit]
+Description=${SERVICE_PREFIX:-zsh} mailer23
+
+[Service]
+ExecStart=/usr/bin/mailer23 --config /etc/mailer23/mailer23.conf
+User=$USER
+EOF
+}
+
+install_api0
+install_worker1
+install_scheduler2
+install_gateway3
+install_metrics4
+install_search5
+install_cache6
+install_mailer7
+install_api8
+install_worker9
+install_scheduler10
+install_gateway11
+install_metrics12
+install_search13
+install_cache14
+install_mailer15
+install_api16
+install_worker17
+install_scheduler18
+install_gateway19
+install_metrics20
+install_search21
+install_cache22
+install_mailer23
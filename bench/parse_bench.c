@@ -0,0 +1,603 @@
+/**
+ * End-to-end parse benchmark.
+ *
+ * Parses each input file with the tree-sitter runtime, the generated parser
+ * and the external scanner, as an editor or `tree-sitter parse` would. Every
+ * file is parsed from scratch once per pass and each parse is timed on its
+ * own, so besides the overall throughput the report carries the median and
+ * tail per-file latency.
+ *
+ * With -e the files are instead edited by the keystroke scripts in the given
+ * edit file (see bench/edits.txt): each script types its text one byte at a
+ * time into a file and every keystroke is followed by an incremental reparse
+ * against the edited old tree, which is what drives external scanner state
+ * replay through deserialize. The report then carries the per-keystroke
+ * reparse latency, the scanner work per keystroke, and how often the changed
+ * ranges of a reparse reach past the line being typed on. After each script
+ * the final tree is compared with a fresh parse of the same text.
+ *
+ * External scanner calls and the size of the serialized state are counted
+ * through a copy of the language whose scanner functions are wrapped, which
+ * leaves the scanner itself untouched.
+ *
+ * With -s the files are not read into memory but streamed from disk through
+ * tree_sitter_zsh_parse_file() in chunks of the given size, and the peak
+ * resident set size is reported after each file. Given files of growing size,
+ * that shows how memory scales with input size apart from the input buffer;
+ * without -s, the peak RSS of the whole run is reported for comparison.
+ *
+ * Files are taken from the command line and, with -l, from a list with one
+ * path per line such as the script/example-files.txt written by
+ * script/parse-examples. The results are printed as `key: value` lines in the
+ * same format as scanner-bench.
+ *
+ * Usage: parse-bench [-p passes] [-s chunk] [-l list] FILE...
+ *        parse-bench [-p passes] -e edits
+ */
+
+#include <tree_sitter/api.h>
+
+#include "tree_sitter/parser.h"
+#include "tree_sitter/tree-sitter-zsh.h"
+
+#include "bench.h"
+
+#include <sys/resource.h>
+
+typedef struct {
+    char *path;
+    char *contents;
+    uint32_t size;
+} BenchFile;
+
+typedef struct {
+    BenchFile *contents;
+    uint32_t size;
+    uint32_t capacity;
+} BenchFiles;
+
+typedef struct {
+    char *path;
+    char *anchor;
+    char *text;
+} BenchEdit;
+
+typedef struct {
+    BenchEdit *contents;
+    uint32_t size;
+    uint32_t capacity;
+} BenchEdits;
+
+typedef struct {
+    double *contents;
+    uint32_t size;
+    uint32_t capacity;
+} BenchLatencies;
+
+typedef struct {
+    uint64_t scans;
+    uint64_t serializations;
+    uint64_t deserializations;
+    uint64_t state_bytes;
+    uint32_t max_state_bytes;
+} BenchCounts;
+
+static BenchCounts counts;
+
+static bool (*scanner_scan)(void *, TSLexer *, const bool *);
+static unsigned (*scanner_serialize)(void *, char *);
+static void (*scanner_deserialize)(void *, const char *, unsigned);
+
+static bool counting_scan(void *payload, TSLexer *lexer,
+                          const bool *valid_symbols) {
+    counts.scans++;
+    return scanner_scan(payload, lexer, valid_symbols);
+}
+
+static unsigned counting_serialize(void *payload, char *buffer) {
+    unsigned size = scanner_serialize(payload, buffer);
+    counts.serializations++;
+    counts.state_bytes += size;
+    if (size > counts.max_state_bytes) {
+        counts.max_state_bytes = size;
+    }
+    return size;
+}
+
+static void counting_deserialize(void *payload, const char *buffer,
+                                 unsigned length) {
+    counts.deserializations++;
+    scanner_deserialize(payload, buffer, length);
+}
+
+static char *copy_string(const char *string) {
+    char *copy = malloc(strlen(string) + 1);
+    strcpy(copy, string);
+    return copy;
+}
+
+static void add_file(BenchFiles *files, const char *path) {
+    if (files->size == files->capacity) {
+        files->capacity = files->capacity ? files->capacity * 2 : 64;
+        files->contents =
+            realloc(files->contents, files->capacity * sizeof(BenchFile));
+    }
+    BenchFile *file = &files->contents[files->size++];
+    file->path = copy_string(path);
+    file->contents = NULL;
+    file->size = 0;
+}
+
+static bool load_files(BenchFiles *files) {
+    for (uint32_t i = 0; i < files->size; i++) {
+        BenchFile *file = &files->contents[i];
+        file->contents = read_file(file->path, &file->size);
+        if (!file->contents) {
+            fprintf(stderr, "cannot read %s\n", file->path);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool add_list_line(void *files, char *line) {
+    add_file(files, line);
+    return true;
+}
+
+// Replaces the escapes \n, \t and \\ in place.
+static void unescape(char *string) {
+    char *output = string;
+    for (char *input = string; *input; input++) {
+        if (*input == '\\' && input[1]) {
+            input++;
+            *output++ = *input == 'n' ? '\n' : *input == 't' ? '\t' : *input;
+        } else {
+            *output++ = *input;
+        }
+    }
+    *output = '\0';
+}
+
+static bool add_edit_line(void *context, char *line) {
+    BenchEdits *edits = context;
+    char *anchor = strchr(line, '\t');
+    char *text = anchor ? strchr(anchor + 1, '\t') : NULL;
+    if (!text) {
+        return false;
+    }
+    *anchor++ = '\0';
+    *text++ = '\0';
+    unescape(anchor);
+    unescape(text);
+    if (!*text) {
+        return false;
+    }
+    if (edits->size == edits->capacity) {
+        edits->capacity = edits->capacity ? edits->capacity * 2 : 16;
+        edits->contents =
+            realloc(edits->contents, edits->capacity * sizeof(BenchEdit));
+    }
+    BenchEdit *edit = &edits->contents[edits->size++];
+    edit->path = copy_string(line);
+    edit->anchor = copy_string(anchor);
+    edit->text = copy_string(text);
+    return true;
+}
+
+static void add_latency(BenchLatencies *latencies, double latency) {
+    if (latencies->size == latencies->capacity) {
+        latencies->capacity = latencies->capacity ? latencies->capacity * 2
+                                                  : 256;
+        latencies->contents = realloc(latencies->contents,
+                                      latencies->capacity * sizeof(double));
+    }
+    latencies->contents[latencies->size++] = latency;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, uint32_t count,
+                         uint32_t percent) {
+    if (count == 0) {
+        return 0.0;
+    }
+    return sorted[(uint64_t)(count - 1) * percent / 100];
+}
+
+static void print_latencies(BenchLatencies *latencies, const char *name) {
+    qsort(latencies->contents, latencies->size, sizeof(double),
+          compare_doubles);
+    printf("%s_p50_ms: %.3f\n", name,
+           percentile(latencies->contents, latencies->size, 50) * 1e3);
+    printf("%s_p99_ms: %.3f\n", name,
+           percentile(latencies->contents, latencies->size, 99) * 1e3);
+}
+
+// The peak resident set size of the process so far, in KiB
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static void print_state_counts(void) {
+    printf("state_bytes_per_serialize: %.2f\n",
+           counts.serializations
+               ? (double)counts.state_bytes / (double)counts.serializations
+               : 0.0);
+    printf("max_state_bytes: %u\n", counts.max_state_bytes);
+}
+
+// Prints the handler counters kept by a scanner built with
+// TREE_SITTER_ZSH_SCANNER_STATS
+static void print_scanner_stats(void) {
+    TSZshScannerStats stats;
+    TSZshHandlerStats handlers[64];
+    if (!tree_sitter_zsh_scanner_stats(&stats, handlers, 64)) {
+        return;
+    }
+    printf("max_context_depth: %u\n", stats.max_context_depth);
+    uint32_t count = stats.handler_count < 64 ? stats.handler_count : 64;
+    for (uint32_t i = 0; i < count; i++) {
+        TSZshHandlerStats *handler = &handlers[i];
+        if (!handler->invocations) {
+            continue;
+        }
+        printf("handler_%s: invocations=%llu accepts=%llu rejects=%llu "
+               "characters=%llu backtracks=%llu backtracked_characters=%llu\n",
+               handler->name, (unsigned long long)handler->invocations,
+               (unsigned long long)handler->accepts,
+               (unsigned long long)handler->rejects,
+               (unsigned long long)handler->characters,
+               (unsigned long long)handler->backtracks,
+               (unsigned long long)handler->backtracked_characters);
+    }
+}
+
+static bool run_files(TSParser *parser, BenchFiles *files, uint32_t passes) {
+    BenchLatencies latencies = {NULL, 0, 0};
+    uint64_t bytes = 0;
+    uint64_t nodes = 0;
+    uint32_t error_files = 0;
+    double elapsed = 0.0;
+    for (uint32_t pass = 0; pass < passes; pass++) {
+        for (uint32_t i = 0; i < files->size; i++) {
+            BenchFile *file = &files->contents[i];
+            double start = now_seconds();
+            TSTree *tree = ts_parser_parse_string(parser, NULL, file->contents,
+                                                  file->size);
+            double latency = now_seconds() - start;
+            if (!tree) {
+                fprintf(stderr, "%s: parse failed\n", file->path);
+                return false;
+            }
+            TSNode root = ts_tree_root_node(tree);
+            nodes += ts_node_descendant_count(root);
+            if (pass == 0 && ts_node_has_error(root)) {
+                error_files++;
+            }
+            ts_tree_delete(tree);
+            add_latency(&latencies, latency);
+            bytes += file->size;
+            elapsed += latency;
+        }
+    }
+
+    printf("files: %u\n", files->size);
+    printf("passes: %u\n", passes);
+    printf("bytes: %llu\n", (unsigned long long)bytes);
+    printf("nodes: %llu\n", (unsigned long long)nodes);
+    printf("error_files: %u\n", error_files);
+    printf("scanner_calls: %llu\n", (unsigned long long)counts.scans);
+    printf("seconds: %.6f\n", elapsed);
+    printf("mb_per_second: %.2f\n",
+           elapsed > 0 ? (double)bytes / elapsed / 1e6 : 0.0);
+    printf("nodes_per_second: %.0f\n",
+           elapsed > 0 ? (double)nodes / elapsed : 0.0);
+    printf("scanner_calls_per_byte: %.3f\n",
+           bytes ? (double)counts.scans / (double)bytes : 0.0);
+    print_state_counts();
+    print_latencies(&latencies, "file");
+    printf("peak_rss_kb: %ld\n", peak_rss_kb());
+    print_scanner_stats();
+    free(latencies.contents);
+    return true;
+}
+
+static bool run_streamed(TSParser *parser, BenchFiles *files, uint32_t passes,
+                         uint32_t chunk_size) {
+    uint64_t bytes = 0;
+    double elapsed = 0.0;
+    printf("chunk_size: %u\n", chunk_size);
+    for (uint32_t i = 0; i < files->size; i++) {
+        BenchFile *file = &files->contents[i];
+        long size = 0;
+        double file_elapsed = 0.0;
+        for (uint32_t pass = 0; pass < passes; pass++) {
+            FILE *input = fopen(file->path, "rb");
+            if (!input) {
+                fprintf(stderr, "cannot read %s\n", file->path);
+                return false;
+            }
+            double start = now_seconds();
+            TSTree *tree =
+                tree_sitter_zsh_parse_file(parser, NULL, input, chunk_size);
+            file_elapsed += now_seconds() - start;
+            if (!tree) {
+                fprintf(stderr, "%s: parse failed\n", file->path);
+                fclose(input);
+                return false;
+            }
+            ts_tree_delete(tree);
+            fseek(input, 0, SEEK_END);
+            size = ftell(input);
+            fclose(input);
+        }
+        bytes += (uint64_t)size * passes;
+        elapsed += file_elapsed;
+        printf("file: %s bytes=%ld seconds=%.6f peak_rss_kb=%ld\n",
+               file->path, size, file_elapsed / passes, peak_rss_kb());
+    }
+
+    printf("files: %u\n", files->size);
+    printf("passes: %u\n", passes);
+    printf("bytes: %llu\n", (unsigned long long)bytes);
+    printf("seconds: %.6f\n", elapsed);
+    printf("mb_per_second: %.2f\n",
+           elapsed > 0 ? (double)bytes / elapsed / 1e6 : 0.0);
+    printf("scanner_calls_per_byte: %.3f\n",
+           bytes ? (double)counts.scans / (double)bytes : 0.0);
+    print_state_counts();
+    printf("peak_rss_kb: %ld\n", peak_rss_kb());
+    print_scanner_stats();
+    return true;
+}
+
+typedef struct {
+    BenchLatencies latencies;
+    uint64_t keystrokes;
+    uint64_t changed_bytes;
+    uint64_t wide_invalidations;
+    uint32_t mismatches;
+    double elapsed;
+} EditCounts;
+
+static TSPoint point_at(const char *text, uint32_t offset) {
+    TSPoint point = {0, 0};
+    for (uint32_t i = 0; i < offset; i++) {
+        if (text[i] == '\n') {
+            point.row++;
+            point.column = 0;
+        } else {
+            point.column++;
+        }
+    }
+    return point;
+}
+
+static bool same_tree(TSTree *a, TSTree *b) {
+    char *a_string = ts_node_string(ts_tree_root_node(a));
+    char *b_string = ts_node_string(ts_tree_root_node(b));
+    bool same = !strcmp(a_string, b_string);
+    free(a_string);
+    free(b_string);
+    return same;
+}
+
+static bool run_edit(TSParser *parser, BenchEdit *edit, bool check,
+                     EditCounts *edit_counts) {
+    uint32_t size = 0;
+    char *contents = read_file(edit->path, &size);
+    if (!contents) {
+        fprintf(stderr, "cannot read %s\n", edit->path);
+        return false;
+    }
+    const char *anchor = strstr(contents, edit->anchor);
+    if (!anchor) {
+        fprintf(stderr, "%s: anchor not found: %s\n", edit->path,
+                edit->anchor);
+        free(contents);
+        return false;
+    }
+    uint32_t offset = (uint32_t)(anchor - contents) + strlen(edit->anchor);
+    uint32_t text_length = (uint32_t)strlen(edit->text);
+    char *text = realloc(contents, size + text_length + 1);
+    uint32_t length = size;
+
+    // Only the reparses after keystrokes are counted, not the parse of the
+    // unedited file or the fresh parse it is checked against.
+    BenchCounts saved = counts;
+    TSTree *tree = ts_parser_parse_string(parser, NULL, text, length);
+    counts = saved;
+    TSPoint point = point_at(text, offset);
+    for (uint32_t i = 0; i < text_length; i++) {
+        char c = edit->text[i];
+        memmove(text + offset + 1, text + offset, length - offset);
+        text[offset] = c;
+        length++;
+
+        TSPoint end = point;
+        if (c == '\n') {
+            end.row++;
+            end.column = 0;
+        } else {
+            end.column++;
+        }
+        TSInputEdit input_edit = {offset, offset, offset + 1,
+                                  point,  point,  end};
+        ts_tree_edit(tree, &input_edit);
+
+        double start = now_seconds();
+        TSTree *new_tree = ts_parser_parse_string(parser, tree, text, length);
+        double latency = now_seconds() - start;
+        add_latency(&edit_counts->latencies, latency);
+        edit_counts->elapsed += latency;
+        edit_counts->keystrokes++;
+
+        // The typed line runs from the start of the line of the edit to the
+        // end of the line holding the inserted byte.
+        uint32_t line_start = offset - point.column;
+        uint32_t line_end = offset + 1;
+        while (line_end < length && text[line_end - 1] != '\n') {
+            line_end++;
+        }
+        uint32_t range_count = 0;
+        TSRange *ranges =
+            ts_tree_get_changed_ranges(tree, new_tree, &range_count);
+        bool wide = false;
+        for (uint32_t j = 0; j < range_count; j++) {
+            edit_counts->changed_bytes +=
+                ranges[j].end_byte - ranges[j].start_byte;
+            if (ranges[j].start_byte < line_start ||
+                ranges[j].end_byte > line_end) {
+                wide = true;
+            }
+        }
+        if (wide) {
+            edit_counts->wide_invalidations++;
+        }
+        free(ranges);
+
+        ts_tree_delete(tree);
+        tree = new_tree;
+        offset++;
+        point = end;
+    }
+
+    if (check) {
+        saved = counts;
+        TSTree *fresh = ts_parser_parse_string(parser, NULL, text, length);
+        if (!same_tree(tree, fresh)) {
+            fprintf(stderr, "%s: incremental tree differs after typing %s\n",
+                    edit->path, edit->text);
+            edit_counts->mismatches++;
+        }
+        ts_tree_delete(fresh);
+        counts = saved;
+    }
+    ts_tree_delete(tree);
+    free(text);
+    return true;
+}
+
+static bool run_edits(TSParser *parser, BenchEdits *edits, uint32_t passes) {
+    EditCounts edit_counts = {{NULL, 0, 0}, 0, 0, 0, 0, 0.0};
+    for (uint32_t pass = 0; pass < passes; pass++) {
+        for (uint32_t i = 0; i < edits->size; i++) {
+            if (!run_edit(parser, &edits->contents[i], pass == 0,
+                          &edit_counts)) {
+                return false;
+            }
+        }
+    }
+
+    uint64_t keystrokes = edit_counts.keystrokes;
+    printf("scripts: %u\n", edits->size);
+    printf("passes: %u\n", passes);
+    printf("keystrokes: %llu\n", (unsigned long long)keystrokes);
+    printf("mismatches: %u\n", edit_counts.mismatches);
+    printf("seconds: %.6f\n", edit_counts.elapsed);
+    printf("scanner_calls_per_edit: %.2f\n",
+           keystrokes ? (double)counts.scans / (double)keystrokes : 0.0);
+    printf("deserializations_per_edit: %.2f\n",
+           keystrokes ? (double)counts.deserializations / (double)keystrokes
+                      : 0.0);
+    printf("state_bytes_per_edit: %.2f\n",
+           keystrokes ? (double)counts.state_bytes / (double)keystrokes : 0.0);
+    print_state_counts();
+    printf("changed_bytes_per_edit: %.2f\n",
+           keystrokes ? (double)edit_counts.changed_bytes / (double)keystrokes
+                      : 0.0);
+    printf("wide_invalidation_rate: %.4f\n",
+           keystrokes
+               ? (double)edit_counts.wide_invalidations / (double)keystrokes
+               : 0.0);
+    print_latencies(&edit_counts.latencies, "edit");
+    print_scanner_stats();
+    free(edit_counts.latencies.contents);
+    return edit_counts.mismatches == 0;
+}
+
+int main(int argc, char **argv) {
+    static const char usage[] =
+        "usage: %s [-p passes] [-s chunk] [-l list] FILE...\n"
+        "       %s [-p passes] -e edits\n";
+    uint32_t passes = 1;
+    uint32_t chunk_size = 0;
+    BenchFiles files = {NULL, 0, 0};
+    BenchEdits edits = {NULL, 0, 0};
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            passes = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            chunk_size = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if (chunk_size == 0) {
+                fprintf(stderr, usage, argv[0], argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+            if (!read_lines(argv[++i], &files, add_list_line)) {
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "-e") && i + 1 < argc) {
+            if (!read_lines(argv[++i], &edits, add_edit_line)) {
+                return 1;
+            }
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, usage, argv[0], argv[0]);
+            return 1;
+        } else {
+            add_file(&files, argv[i]);
+        }
+    }
+    if ((files.size == 0) == (edits.size == 0) || passes == 0 ||
+        (chunk_size && edits.size)) {
+        fprintf(stderr, usage, argv[0], argv[0]);
+        return 1;
+    }
+    if (!chunk_size && !load_files(&files)) {
+        return 1;
+    }
+
+    TSLanguage language = *tree_sitter_zsh();
+    scanner_scan = language.external_scanner.scan;
+    scanner_serialize = language.external_scanner.serialize;
+    scanner_deserialize = language.external_scanner.deserialize;
+    language.external_scanner.scan = counting_scan;
+    language.external_scanner.serialize = counting_serialize;
+    language.external_scanner.deserialize = counting_deserialize;
+
+    TSParser *parser = ts_parser_new();
+    if (!ts_parser_set_language(parser, &language)) {
+        fprintf(stderr, "incompatible tree-sitter runtime\n");
+        return 1;
+    }
+    bool ok = chunk_size   ? run_streamed(parser, &files, passes, chunk_size)
+              : files.size ? run_files(parser, &files, passes)
+                           : run_edits(parser, &edits, passes);
+    ts_parser_delete(parser);
+
+    for (uint32_t i = 0; i < files.size; i++) {
+        free(files.contents[i].path);
+        free(files.contents[i].contents);
+    }
+    free(files.contents);
+    for (uint32_t i = 0; i < edits.size; i++) {
+        free(edits.contents[i].path);
+        free(edits.contents[i].anchor);
+        free(edits.contents[i].text);
+    }
+    free(edits.contents);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,656 @@
+/**
+ * Micro-benchmark for the external scanner.
+ *
+ * Drives the scanner directly with a minimal TSLexer over each input file,
+ * without the tree-sitter runtime. At every position an external lex state is
+ * picked from the language's own table of valid external symbol sets, the
+ * scanner state is restored from the last accepted token as the runtime does,
+ * and the scanner is invoked. Accepted tokens move the position to the token
+ * end, rejected calls move it by one character.
+ *
+ * The choice of lex state is pseudo-random with a fixed seed, so two builds
+ * that produce the same tokens perform exactly the same sequence of calls and
+ * their timings and branch counts can be compared directly.
+ *
+ * With -H every paragraph of each file is instead wrapped in its own quoted
+ * (raw) heredoc and only the heredoc tokens are valid, so the timing is that of
+ * matching delimiters and scanning heredoc bodies.
+ *
+ * With -R the scanner is instead invoked after every `=~` of each file, once
+ * for each of the regex tokens with only that token valid, so the timing is
+ * that of scanning the right-hand sides of regex matches.
+ *
+ * When the scanner is built with TREE_SITTER_REUSE_ALLOCATOR, its allocations
+ * go through hooks defined here and are reported per MB of input.
+ *
+ * With -E the scanner is instead invoked at every position of each file with
+ * every symbol valid, as the runtime does while it recovers from a syntax
+ * error, so the timing is that of the recovery path. Accepted tokens move the
+ * position to the token end as above.
+ *
+ * With -t the scanner trace of a scanner built with
+ * TREE_SITTER_ZSH_SCANNER_TRACE is written to the given file at the end of the
+ * run, for script/decode-scanner-trace.
+ *
+ * Usage: scanner-bench [-H] [-R] [-E] [-p passes] [-s seed] [-t trace] FILE...
+ */
+
+#ifdef __linux__
+#define _DEFAULT_SOURCE
+#endif
+
+#include "tree_sitter/parser.h"
+#include "tree_sitter/tree-sitter-zsh.h"
+
+#include "bench.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef TREE_SITTER_REUSE_ALLOCATOR
+static uint64_t allocations;
+
+static void *counting_malloc(size_t size) {
+    allocations++;
+    return malloc(size);
+}
+
+static void *counting_calloc(size_t count, size_t size) {
+    allocations++;
+    return calloc(count, size);
+}
+
+static void *counting_realloc(void *ptr, size_t size) {
+    allocations++;
+    return realloc(ptr, size);
+}
+
+void *(*ts_current_malloc)(size_t size) = counting_malloc;
+void *(*ts_current_calloc)(size_t count, size_t size) = counting_calloc;
+void *(*ts_current_realloc)(void *ptr, size_t size) = counting_realloc;
+void (*ts_current_free)(void *ptr) = free;
+#endif
+
+typedef struct {
+    TSLexer lexer;
+    const int32_t *text;
+    uint32_t length;
+    uint32_t position;
+    uint32_t token_end;
+    bool did_mark_end;
+    uint64_t advances;
+} BenchLexer;
+
+static void bench_lexer_update(BenchLexer *self) {
+    self->lexer.lookahead =
+        self->position < self->length ? self->text[self->position] : 0;
+}
+
+static void bench_advance(TSLexer *lexer, bool skip) {
+    BenchLexer *self = (BenchLexer *)lexer;
+    (void)skip;
+    self->advances++;
+    if (self->position < self->length) {
+        self->position++;
+    }
+    bench_lexer_update(self);
+}
+
+static void bench_mark_end(TSLexer *lexer) {
+    BenchLexer *self = (BenchLexer *)lexer;
+    self->token_end = self->position;
+    self->did_mark_end = true;
+}
+
+static uint32_t bench_get_column(TSLexer *lexer) {
+    BenchLexer *self = (BenchLexer *)lexer;
+    uint32_t column = 0;
+    while (column < self->position &&
+           self->text[self->position - column - 1] != '\n') {
+        column++;
+    }
+    return column;
+}
+
+static bool bench_is_at_included_range_start(const TSLexer *lexer) {
+    (void)lexer;
+    return false;
+}
+
+static bool bench_eof(const TSLexer *lexer) {
+    const BenchLexer *self = (const BenchLexer *)lexer;
+    return self->position >= self->length;
+}
+
+static void bench_lexer_init(BenchLexer *self, const int32_t *text,
+                             uint32_t length, uint32_t position) {
+    self->lexer.advance = bench_advance;
+    self->lexer.mark_end = bench_mark_end;
+    self->lexer.get_column = bench_get_column;
+    self->lexer.is_at_included_range_start = bench_is_at_included_range_start;
+    self->lexer.eof = bench_eof;
+    self->lexer.log = NULL;
+    self->text = text;
+    self->length = length;
+    self->position = position;
+    self->token_end = position;
+    self->did_mark_end = false;
+    self->advances = 0;
+    bench_lexer_update(self);
+}
+
+// Decode UTF-8 into code points, passing invalid bytes through unchanged
+static uint32_t decode_utf8(const unsigned char *bytes, size_t size,
+                            int32_t *text) {
+    uint32_t length = 0;
+    size_t i = 0;
+    while (i < size) {
+        unsigned char c = bytes[i];
+        int extra = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : 0;
+        int32_t code_point = extra ? c & (0x3f >> extra) : c;
+        if (i + extra >= size) {
+            extra = 0;
+            code_point = c;
+        }
+        for (int k = 1; k <= extra; k++) {
+            code_point = (code_point << 6) | (bytes[i + k] & 0x3f);
+        }
+        text[length++] = code_point;
+        i += extra + 1;
+    }
+    return length;
+}
+
+// Prints the handler counters kept by a scanner built with
+// TREE_SITTER_ZSH_SCANNER_STATS
+static void print_scanner_stats(void) {
+    TSZshScannerStats stats;
+    TSZshHandlerStats handlers[64];
+    if (!tree_sitter_zsh_scanner_stats(&stats, handlers, 64)) {
+        return;
+    }
+    printf("max_context_depth: %u\n", stats.max_context_depth);
+    uint32_t count = stats.handler_count < 64 ? stats.handler_count : 64;
+    for (uint32_t i = 0; i < count; i++) {
+        TSZshHandlerStats *handler = &handlers[i];
+        if (!handler->invocations) {
+            continue;
+        }
+        printf("handler_%s: invocations=%llu accepts=%llu rejects=%llu "
+               "characters=%llu backtracks=%llu backtracked_characters=%llu\n",
+               handler->name, (unsigned long long)handler->invocations,
+               (unsigned long long)handler->accepts,
+               (unsigned long long)handler->rejects,
+               (unsigned long long)handler->characters,
+               (unsigned long long)handler->backtracks,
+               (unsigned long long)handler->backtracked_characters);
+    }
+}
+
+// Writes the trace of the scanner to `path`
+static bool write_trace(const char *path) {
+    uint32_t size = tree_sitter_zsh_scanner_trace(NULL, 0);
+    if (size == 0) {
+        fprintf(stderr, "the scanner was built without tracing\n");
+        return false;
+    }
+    char *trace = malloc(size);
+    tree_sitter_zsh_scanner_trace(trace, size);
+    FILE *file = fopen(path, "wb");
+    bool ok = file && fwrite(trace, 1, size, file) == size;
+    if (file) {
+        ok = fclose(file) == 0 && ok;
+    }
+    if (!ok) {
+        fprintf(stderr, "cannot write %s\n", path);
+    }
+    free(trace);
+    return ok;
+}
+
+static uint64_t rng_state;
+
+static uint32_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)rng_state;
+}
+
+#ifdef __linux__
+static int open_counter(uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t read_counter(int fd) {
+    uint64_t value = 0;
+    if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value)) {
+        return 0;
+    }
+    return value;
+}
+#endif
+
+typedef struct {
+    uint64_t calls;
+    uint64_t concat_calls;
+    uint64_t tokens;
+    uint64_t advances;
+    uint64_t state_bytes;
+} BenchCounts;
+
+#define HEREDOC_DELIMITER "SCANNER_BENCH_EOF"
+
+// Token types of the external scanner looked at by the benchmark, in the order
+// of the grammar's externals
+enum {
+    BENCH_HEREDOC_START = 0,
+    BENCH_SIMPLE_HEREDOC_BODY = 1,
+    BENCH_HEREDOC_BODY_BEGINNING = 2,
+    BENCH_HEREDOC_END = 4,
+    BENCH_CONCAT = 7,
+    BENCH_CONCAT_REGEX = 8,
+    BENCH_REGEX = 13,
+    BENCH_REGEX_NO_SLASH = 14,
+    BENCH_REGEX_NO_SPACE = 15,
+    BENCH_HEREDOC_ARROW = 30,
+    BENCH_ERROR_RECOVERY = 48,
+};
+
+// Wrap every paragraph of the file contents as the body of its own
+// <<'SCANNER_BENCH_EOF' heredoc. With no output text, only measure the size.
+static uint32_t wrap_heredocs(const int32_t *body, uint32_t length,
+                              int32_t *text) {
+    static const char prefix[] = "<<'" HEREDOC_DELIMITER "'\n";
+    static const char suffix[] = HEREDOC_DELIMITER "\n";
+    uint32_t size = 0;
+    uint32_t i = 0;
+    while (i < length) {
+        while (i < length && body[i] == '\n') {
+            i++;
+        }
+        if (i == length) {
+            break;
+        }
+        for (const char *c = prefix; *c; c++, size++) {
+            if (text) {
+                text[size] = *c;
+            }
+        }
+        // Copy lines up to the next blank line
+        int32_t previous = '\n';
+        while (i < length && !(body[i] == '\n' && previous == '\n')) {
+            previous = body[i];
+            if (text) {
+                text[size] = body[i];
+            }
+            size++;
+            i++;
+        }
+        if (previous != '\n') {
+            if (text) {
+                text[size] = '\n';
+            }
+            size++;
+        }
+        for (const char *c = suffix; *c; c++, size++) {
+            if (text) {
+                text[size] = *c;
+            }
+        }
+    }
+    return size;
+}
+
+// Scan the arrow, the delimiter, the body and the end of each heredoc, with
+// only the tokens of each step valid
+static bool run_heredocs(const TSLanguage *language, void *scanner,
+                         const int32_t *text, uint32_t length,
+                         BenchCounts *counts) {
+    static const int steps[][2] = {
+        {BENCH_HEREDOC_ARROW, -1},
+        {BENCH_HEREDOC_START, -1},
+        {BENCH_SIMPLE_HEREDOC_BODY, BENCH_HEREDOC_BODY_BEGINNING},
+        {BENCH_HEREDOC_END, -1},
+    };
+    size_t step_count = sizeof(steps) / sizeof(steps[0]);
+    char state[TREE_SITTER_SERIALIZATION_BUFFER_SIZE] = {0};
+    unsigned state_length = 0;
+    uint32_t position = 0;
+
+    language->external_scanner.deserialize(scanner, state, 0);
+    for (size_t step = 0; position < length; step = (step + 1) % step_count) {
+        bool valid_symbols[BENCH_ERROR_RECOVERY + 1] = {false};
+        valid_symbols[steps[step][0]] = true;
+        if (steps[step][1] >= 0) {
+            valid_symbols[steps[step][1]] = true;
+        }
+        // The newlines after the delimiters are lexed by the parser itself
+        if ((step == 0 || step == 2) && text[position] == '\n') {
+            position++;
+            if (position == length) {
+                break;
+            }
+        }
+
+        BenchLexer lexer;
+        bench_lexer_init(&lexer, text, length, position);
+        language->external_scanner.deserialize(scanner, state, state_length);
+        bool found = language->external_scanner.scan(scanner, &lexer.lexer,
+                                                     valid_symbols);
+        counts->calls++;
+        counts->advances += lexer.advances;
+        if (!found) {
+            return false;
+        }
+        state_length = language->external_scanner.serialize(scanner, state);
+        counts->tokens++;
+        counts->state_bytes += state_length;
+        position = lexer.did_mark_end ? lexer.token_end : lexer.position;
+    }
+    return true;
+}
+
+// Scan the right-hand side of every `=~` as each of the regex tokens, from the
+// initial scanner state
+static void run_regexes(const TSLanguage *language, void *scanner,
+                        const int32_t *text, uint32_t length,
+                        BenchCounts *counts) {
+    static const int symbols[] = {
+        BENCH_REGEX,
+        BENCH_REGEX_NO_SLASH,
+        BENCH_REGEX_NO_SPACE,
+    };
+    char state[TREE_SITTER_SERIALIZATION_BUFFER_SIZE] = {0};
+
+    for (uint32_t i = 0; i + 1 < length; i++) {
+        if (text[i] != '=' || text[i + 1] != '~') {
+            continue;
+        }
+        for (size_t k = 0; k < sizeof(symbols) / sizeof(symbols[0]); k++) {
+            bool valid_symbols[BENCH_ERROR_RECOVERY + 1] = {false};
+            valid_symbols[symbols[k]] = true;
+
+            BenchLexer lexer;
+            bench_lexer_init(&lexer, text, length, i + 2);
+            language->external_scanner.deserialize(scanner, state, 0);
+            bool found = language->external_scanner.scan(scanner, &lexer.lexer,
+                                                         valid_symbols);
+            counts->calls++;
+            counts->advances += lexer.advances;
+            if (found) {
+                counts->tokens++;
+                counts->state_bytes +=
+                    language->external_scanner.serialize(scanner, state);
+            }
+        }
+    }
+}
+
+// Scan every position with all symbols valid, including ERROR_RECOVERY
+static void run_recovery(const TSLanguage *language, void *scanner,
+                         const int32_t *text, uint32_t length,
+                         BenchCounts *counts) {
+    char state[TREE_SITTER_SERIALIZATION_BUFFER_SIZE] = {0};
+    unsigned state_length = 0;
+    uint32_t position = 0;
+    bool valid_symbols[BENCH_ERROR_RECOVERY + 1];
+    memset(valid_symbols, true, sizeof(valid_symbols));
+
+    language->external_scanner.deserialize(scanner, state, 0);
+    while (position < length) {
+        BenchLexer lexer;
+        bench_lexer_init(&lexer, text, length, position);
+        language->external_scanner.deserialize(scanner, state, state_length);
+        bool found = language->external_scanner.scan(scanner, &lexer.lexer,
+                                                     valid_symbols);
+        counts->calls++;
+        counts->concat_calls++;
+        counts->advances += lexer.advances;
+        if (found) {
+            uint32_t end =
+                lexer.did_mark_end ? lexer.token_end : lexer.position;
+            state_length =
+                language->external_scanner.serialize(scanner, state);
+            counts->tokens++;
+            counts->state_bytes += state_length;
+            position = end > position ? end : position + 1;
+        } else {
+            position++;
+        }
+    }
+}
+
+static void run_file(const TSLanguage *language, void *scanner,
+                     const int32_t *text, uint32_t length,
+                     const bool *external_states, uint32_t state_count,
+                     BenchCounts *counts) {
+    char state[TREE_SITTER_SERIALIZATION_BUFFER_SIZE] = {0};
+    unsigned state_length = 0;
+    uint32_t position = 0;
+    uint32_t external_count = language->external_token_count;
+
+    language->external_scanner.deserialize(scanner, state, 0);
+    while (position < length) {
+        const bool *valid_symbols =
+            &external_states[(1 + rng_next() % (state_count - 1)) *
+                             external_count];
+        BenchLexer lexer;
+        bench_lexer_init(&lexer, text, length, position);
+
+        language->external_scanner.deserialize(scanner, state, state_length);
+        bool found =
+            language->external_scanner.scan(scanner, &lexer.lexer,
+                                            valid_symbols);
+        counts->calls++;
+        counts->concat_calls +=
+            valid_symbols[BENCH_CONCAT] || valid_symbols[BENCH_CONCAT_REGEX];
+        counts->advances += lexer.advances;
+        if (found) {
+            uint32_t end =
+                lexer.did_mark_end ? lexer.token_end : lexer.position;
+            state_length =
+                language->external_scanner.serialize(scanner, state);
+            counts->tokens++;
+            counts->state_bytes += state_length;
+            position = end > position ? end : position + 1;
+        } else {
+            position++;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    static const char usage[] =
+        "usage: %s [-H] [-R] [-E] [-p passes] [-s seed] [-t trace] FILE...\n";
+    uint32_t passes = 1;
+    uint64_t seed = 88172645463325252ULL;
+    bool heredoc_mode = false;
+    bool regex_mode = false;
+    bool recovery_mode = false;
+    const char *trace_path = NULL;
+    int first_file = 1;
+
+    while (first_file < argc && argv[first_file][0] == '-') {
+        if (!strcmp(argv[first_file], "-H")) {
+            heredoc_mode = true;
+            first_file++;
+            continue;
+        }
+        if (!strcmp(argv[first_file], "-R")) {
+            regex_mode = true;
+            first_file++;
+            continue;
+        }
+        if (!strcmp(argv[first_file], "-E")) {
+            recovery_mode = true;
+            first_file++;
+            continue;
+        }
+        if (!strcmp(argv[first_file], "-p") && first_file + 1 < argc) {
+            passes = (uint32_t)strtoul(argv[first_file + 1], NULL, 10);
+        } else if (!strcmp(argv[first_file], "-s") && first_file + 1 < argc) {
+            seed = strtoull(argv[first_file + 1], NULL, 10);
+        } else if (!strcmp(argv[first_file], "-t") && first_file + 1 < argc) {
+            trace_path = argv[first_file + 1];
+        } else {
+            fprintf(stderr, usage, argv[0]);
+            return 1;
+        }
+        first_file += 2;
+    }
+    if (first_file >= argc) {
+        fprintf(stderr, usage, argv[0]);
+        return 1;
+    }
+
+    const TSLanguage *language = tree_sitter_zsh();
+    uint32_t state_count = 0;
+    for (uint32_t i = 0; i < language->state_count; i++) {
+        uint32_t external = language->lex_modes[i].external_lex_state;
+        if (external + 1 > state_count) {
+            state_count = external + 1;
+        }
+    }
+    if (state_count < 2) {
+        fprintf(stderr, "language has no external lex states\n");
+        return 1;
+    }
+
+    uint32_t file_count = (uint32_t)(argc - first_file);
+    int32_t **texts = calloc(file_count, sizeof(int32_t *));
+    uint32_t *lengths = calloc(file_count, sizeof(uint32_t));
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < file_count; i++) {
+        uint32_t size = 0;
+        char *contents = read_file(argv[first_file + i], &size);
+        if (!contents) {
+            fprintf(stderr, "cannot read %s\n", argv[first_file + i]);
+            return 1;
+        }
+        texts[i] = malloc((size + 1) * sizeof(int32_t));
+        lengths[i] =
+            decode_utf8((const unsigned char *)contents, size, texts[i]);
+        if (heredoc_mode) {
+            uint32_t wrapped = wrap_heredocs(texts[i], lengths[i], NULL);
+            int32_t *text = malloc((wrapped + 1) * sizeof(int32_t));
+            lengths[i] = wrap_heredocs(texts[i], lengths[i], text);
+            free(texts[i]);
+            texts[i] = text;
+        }
+        bytes += size;
+        free(contents);
+    }
+
+#ifdef __linux__
+    int branches_fd = open_counter(PERF_COUNT_HW_BRANCH_INSTRUCTIONS);
+    int instructions_fd = open_counter(PERF_COUNT_HW_INSTRUCTIONS);
+    int cycles_fd = open_counter(PERF_COUNT_HW_CPU_CYCLES);
+    if (branches_fd >= 0) {
+        ioctl(branches_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    if (instructions_fd >= 0) {
+        ioctl(instructions_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    if (cycles_fd >= 0) {
+        ioctl(cycles_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+
+    void *scanner = language->external_scanner.create();
+    BenchCounts counts = {0, 0, 0, 0, 0};
+    rng_state = seed;
+    double start = now_seconds();
+    for (uint32_t pass = 0; pass < passes; pass++) {
+        for (uint32_t i = 0; i < file_count; i++) {
+            if (regex_mode) {
+                run_regexes(language, scanner, texts[i], lengths[i], &counts);
+            } else if (recovery_mode) {
+                run_recovery(language, scanner, texts[i], lengths[i], &counts);
+            } else if (!heredoc_mode) {
+                run_file(language, scanner, texts[i], lengths[i],
+                         language->external_scanner.states, state_count,
+                         &counts);
+            } else if (!run_heredocs(language, scanner, texts[i], lengths[i],
+                                     &counts)) {
+                fprintf(stderr, "%s: heredoc was not scanned as one body\n",
+                        argv[first_file + i]);
+                return 1;
+            }
+        }
+    }
+    double elapsed = now_seconds() - start;
+    if (trace_path && !write_trace(trace_path)) {
+        return 1;
+    }
+    language->external_scanner.destroy(scanner);
+
+    printf("files: %u\n", file_count);
+    printf("passes: %u\n", passes);
+    printf("bytes: %llu\n", (unsigned long long)(bytes * passes));
+    printf("calls: %llu\n", (unsigned long long)counts.calls);
+    printf("tokens: %llu\n", (unsigned long long)counts.tokens);
+    printf("concat_calls_per_byte: %.3f\n",
+           bytes ? (double)counts.concat_calls / (double)(bytes * passes)
+                 : 0.0);
+    printf("advances_per_call: %.2f\n",
+           counts.calls ? (double)counts.advances / (double)counts.calls
+                        : 0.0);
+    printf("state_bytes_per_token: %.2f\n",
+           counts.tokens ? (double)counts.state_bytes / (double)counts.tokens
+                         : 0.0);
+    printf("seconds: %.6f\n", elapsed);
+    printf("ns_per_call: %.2f\n",
+           counts.calls ? elapsed * 1e9 / (double)counts.calls : 0.0);
+    printf("ns_per_token: %.2f\n",
+           counts.tokens ? elapsed * 1e9 / (double)counts.tokens : 0.0);
+    printf("ns_per_character: %.3f\n",
+           counts.advances ? elapsed * 1e9 / (double)counts.advances : 0.0);
+    printf("mb_per_second: %.2f\n",
+           elapsed > 0 ? (double)(bytes * passes) / elapsed / 1e6 : 0.0);
+#ifdef TREE_SITTER_REUSE_ALLOCATOR
+    printf("allocations_per_mb: %.2f\n",
+           bytes ? (double)allocations / ((double)(bytes * passes) / 1e6)
+                 : 0.0);
+#endif
+
+#ifdef __linux__
+    uint64_t branches = read_counter(branches_fd);
+    uint64_t instructions = read_counter(instructions_fd);
+    uint64_t cycles = read_counter(cycles_fd);
+    if (branches && counts.calls) {
+        printf("branches_per_call: %.2f\n",
+               (double)branches / (double)counts.calls);
+        printf("branches_per_token: %.2f\n",
+               (double)branches / (double)counts.tokens);
+    }
+    if (instructions && counts.calls) {
+        printf("instructions_per_call: %.2f\n",
+               (double)instructions / (double)counts.calls);
+    }
+    if (cycles && counts.tokens) {
+        printf("cycles_per_token: %.2f\n",
+               (double)cycles / (double)counts.tokens);
+    }
+#endif
+    print_scanner_stats();
+
+    for (uint32_t i = 0; i < file_count; i++) {
+        free(texts[i]);
+    }
+    free(texts);
+    free(lengths);
+    return 0;
+}
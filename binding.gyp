@@ -1,4 +1,10 @@
 {
+  "variables": {
+    # parseBatch() is only built with TREE_SITTER_ZSH_PARSE_BATCH=1, since it
+    # links against the tree-sitter runtime found by pkg-config, which the
+    # published prebuilds do not ship
+    "tree_sitter_zsh_parse_batch%": "<!(node -p \"process.env.TREE_SITTER_ZSH_PARSE_BATCH === '1' ? 1 : 0\")",
+  },
   "targets": [
     {
       "target_name": "tree_sitter_zsh_binding",
@@ -24,6 +30,22 @@
             "/utf-8",
           ],
         }],
+        ["tree_sitter_zsh_parse_batch==1", {
+          "defines": [
+            "TREE_SITTER_ZSH_PARSE_BATCH",
+          ],
+          "cflags_cc": [
+            "<!@(pkg-config --cflags tree-sitter)",
+          ],
+          "xcode_settings": {
+            "OTHER_CPLUSPLUSFLAGS": [
+              "<!@(pkg-config --cflags tree-sitter)",
+            ],
+          },
+          "libraries": [
+            "<!@(pkg-config --libs tree-sitter)",
+          ],
+        }],
       ],
     }
   ]
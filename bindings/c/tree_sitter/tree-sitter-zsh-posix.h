@@ -0,0 +1,37 @@
+#ifndef TREE_SITTER_ZSH_POSIX_H_
+#define TREE_SITTER_ZSH_POSIX_H_
+
+// The tree-sitter-zsh-posix library, built with the CMake option
+// TREE_SITTER_ZSH_POSIX_LANGUAGE or the Makefile's posix target. Its scanner
+// functions are those of tree-sitter-zsh.h under the tree_sitter_zsh_posix
+// prefix; that header is included for their types only.
+
+#include "tree-sitter-zsh.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The grammar without its zsh extensions, for tools that only need POSIX and
+// bash-shaped parsing.
+const TSLanguage *tree_sitter_zsh_posix(void);
+
+bool tree_sitter_zsh_posix_scanner_stats(TSZshScannerStats *stats,
+                                         TSZshHandlerStats *handlers,
+                                         uint32_t handler_capacity);
+
+void tree_sitter_zsh_posix_scanner_stats_reset(void);
+
+uint32_t tree_sitter_zsh_posix_scanner_trace(char *buffer, uint32_t size);
+
+uint32_t tree_sitter_zsh_posix_split_points(const char *source,
+                                            uint32_t length,
+                                            uint32_t chunk_size,
+                                            uint32_t *points,
+                                            uint32_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TREE_SITTER_ZSH_POSIX_H_
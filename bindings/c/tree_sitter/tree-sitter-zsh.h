@@ -1,6 +1,9 @@
 #ifndef TREE_SITTER_ZSH_H_
 #define TREE_SITTER_ZSH_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
 typedef struct TSLanguage TSLanguage;
 
 #ifdef __cplusplus
@@ -9,8 +12,143 @@ extern "C" {
 
 const TSLanguage *tree_sitter_zsh(void);
 
+// Counters of one external scanner handler. A handler is invoked when a scan
+// tries it, is credited with the characters consumed until the next handler
+// is tried, and counts as accepted when it was the last handler of a scan
+// that produced a token and as rejected otherwise. A reject after consuming
+// characters is a backtrack, which makes the internal lexer read them again.
+typedef struct {
+    const char *name;
+    uint64_t invocations;
+    uint64_t accepts;
+    uint64_t rejects;
+    uint64_t characters;
+    uint64_t backtracks;
+    uint64_t backtracked_characters;
+} TSZshHandlerStats;
+
+typedef struct {
+    uint64_t scans;
+    uint32_t max_context_depth;
+    uint32_t handler_count;
+} TSZshScannerStats;
+
+// Copies the scanner counters of the calling thread since the last reset into
+// `stats`, and those of the first `handler_capacity` handlers into `handlers`.
+// Returns false, with every counter zero, unless the scanner was built with
+// TREE_SITTER_ZSH_SCANNER_STATS.
+bool tree_sitter_zsh_scanner_stats(TSZshScannerStats *stats,
+                                   TSZshHandlerStats *handlers,
+                                   uint32_t handler_capacity);
+
+// Zeroes the scanner counters of the calling thread.
+void tree_sitter_zsh_scanner_stats_reset(void);
+
+// Exports the trace of the scanner that last ran on the calling thread, as
+// decoded by script/decode-scanner-trace: its most recent events, oldest
+// first. Returns the size of the trace, writing it only when `size` is enough
+// to hold it, or 0 unless the scanner was built with
+// TREE_SITTER_ZSH_SCANNER_TRACE. The trace must be taken before that parser
+// is deleted.
+uint32_t tree_sitter_zsh_scanner_trace(char *buffer, uint32_t size);
+
+// Finds where `source` can be cut into independently parseable pieces, for
+// parsing one large file on several threads. Writes up to `capacity` offsets
+// of line starts, in increasing order and excluding 0, at which a top-level
+// statement begins, each the first such line at least `chunk_size` bytes past
+// the previous one, or every such line when `chunk_size` is 0. The area
+// before a line holds no open quote, bracket, compound command, heredoc or
+// pipeline. The pass stops early at anything it cannot follow, so the last
+// piece may be larger than asked for. Returns the number of offsets written.
+uint32_t tree_sitter_zsh_split_points(const char *source, uint32_t length,
+                                      uint32_t chunk_size, uint32_t *points,
+                                      uint32_t capacity);
+
 #ifdef __cplusplus
 }
 #endif
 
+#ifdef TREE_SITTER_API_H_
+
+// Streaming input, declared when tree_sitter/api.h is included first. These
+// are inline so that the grammar library itself does not depend on the
+// runtime.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A file read through TSInput one chunk at a time, so that parsing it needs
+// `capacity` bytes of input buffer whatever its size. The runtime asks for
+// the chunk at each byte offset it needs, mostly in order, and the file is
+// only repositioned when it asks for another one.
+typedef struct {
+    FILE *file;
+    long position;
+    int error;
+    uint32_t capacity;
+    char *buffer;
+} TSZshFileInput;
+
+static inline const char *tree_sitter_zsh_file_read(void *payload,
+                                                    uint32_t byte_index,
+                                                    TSPoint position,
+                                                    uint32_t *bytes_read) {
+    TSZshFileInput *input = (TSZshFileInput *)payload;
+    (void)position;
+    *bytes_read = 0;
+    if (input->position != (long)byte_index) {
+        if (fseek(input->file, (long)byte_index, SEEK_SET) != 0) {
+            input->error = errno ? errno : EIO;
+            return input->buffer;
+        }
+        input->position = (long)byte_index;
+    }
+    size_t size = fread(input->buffer, 1, input->capacity, input->file);
+    if (size < input->capacity && ferror(input->file)) {
+        input->error = errno ? errno : EIO;
+    }
+    input->position += (long)size;
+    *bytes_read = (uint32_t)size;
+    return input->buffer;
+}
+
+// Parses the UTF-8 file open for binary reading as `file` from its start,
+// through chunks of `chunk_size` bytes, or 64 KiB when it is 0. Returns NULL
+// with errno set when the file cannot be read, and NULL when the parse is
+// cancelled or times out. Files are limited to the range of TSInput offsets,
+// 4 GiB, and of long.
+static inline TSTree *tree_sitter_zsh_parse_file(TSParser *parser,
+                                                 const TSTree *old_tree,
+                                                 FILE *file,
+                                                 uint32_t chunk_size) {
+    TSZshFileInput input;
+    input.file = file;
+    input.position = -1;
+    input.error = 0;
+    input.capacity = chunk_size ? chunk_size : 64 * 1024;
+    input.buffer = (char *)malloc(input.capacity);
+    if (!input.buffer) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    TSInput source;
+    memset(&source, 0, sizeof(source));
+    source.payload = &input;
+    source.read = tree_sitter_zsh_file_read;
+    source.encoding = TSInputEncodingUTF8;
+    TSTree *tree = ts_parser_parse(parser, old_tree, source);
+    free(input.buffer);
+    if (input.error) {
+        ts_tree_delete(tree);
+        errno = input.error;
+        return NULL;
+    }
+    return tree;
+}
+
+#endif // TREE_SITTER_API_H_
+
 #endif // TREE_SITTER_ZSH_H_
@@ -9,11 +9,243 @@ const napi_type_tag LANGUAGE_TYPE_TAG = {
     0x8AF2E5212AD58ABF, 0xD5006CAD83ABBA16
 };
 
+#ifdef TREE_SITTER_ZSH_PARSE_BATCH
+
+// Batch parsing on the libuv thread pool, so that parsing many files does not
+// block the event loop. It is only built with TREE_SITTER_ZSH_PARSE_BATCH=1,
+// and links the installed tree-sitter runtime.
+
+#include <tree_sitter/api.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct ParseResult {
+    bool has_error = false;
+    uint32_t node_count = 0;
+    std::string tree;
+};
+
+// A work item parses at most this many sources, and at most this many bytes
+// unless a single source is larger, so that it never keeps a pool thread for
+// long
+constexpr size_t ITEM_SOURCES = 64;
+constexpr uint64_t ITEM_BYTES = 1 << 20;
+
+// One parseBatch() call, shared by the work items it is split into. The
+// sources array is referenced until the batch settles, so that the memory of
+// its buffers is parsed in place.
+struct ParseBatch {
+    ParseBatch(Napi::Env env, Napi::Array sources, bool trees)
+        : deferred(Napi::Promise::Deferred::New(env)),
+          sources(Napi::Persistent(sources)), trees(trees) {}
+
+    Napi::Promise::Deferred deferred;
+    Napi::Reference<Napi::Array> sources;
+    std::vector<std::pair<const char *, uint32_t>> inputs;
+    std::vector<ParseResult> results;
+    bool trees;
+    // The first input of the next work item, and the items queued and not
+    // yet done
+    size_t next = 0;
+    size_t in_flight = 0;
+    size_t max_in_flight = 1;
+    std::string error;
+};
+
+void queue_items(Napi::Env env, const std::shared_ptr<ParseBatch> &batch);
+
+// Each pool thread keeps its parser for the lifetime of the process
+TSParser *thread_parser() {
+    static thread_local std::unique_ptr<TSParser, void (*)(TSParser *)> parser(
+        nullptr, ts_parser_delete);
+    if (!parser) {
+        parser.reset(ts_parser_new());
+        ts_parser_set_language(parser.get(), tree_sitter_zsh());
+    }
+    return parser.get();
+}
+
+// The results of a batch as an array of {hasError, nodeCount, tree} objects
+Napi::Array summaries(Napi::Env env, const ParseBatch &batch) {
+    Napi::Array array = Napi::Array::New(env, batch.results.size());
+    for (size_t i = 0; i < batch.results.size(); i++) {
+        const ParseResult &result = batch.results[i];
+        Napi::Object summary = Napi::Object::New(env);
+        summary["hasError"] = Napi::Boolean::New(env, result.has_error);
+        summary["nodeCount"] = Napi::Number::New(env, result.node_count);
+        if (batch.trees) {
+            summary["tree"] = Napi::String::New(env, result.tree);
+        }
+        array[static_cast<uint32_t>(i)] = summary;
+    }
+    return array;
+}
+
+class ParseBatchWorker : public Napi::AsyncWorker {
+  public:
+    ParseBatchWorker(Napi::Env env, std::shared_ptr<ParseBatch> batch,
+                     size_t begin, size_t end)
+        : Napi::AsyncWorker(env), batch(std::move(batch)), begin(begin),
+          end(end) {}
+
+    void Execute() override {
+        TSParser *parser = thread_parser();
+        for (size_t i = begin; i < end; i++) {
+            const auto &input = batch->inputs[i];
+            TSTree *tree = ts_parser_parse_string(parser, nullptr, input.first,
+                                                  input.second);
+            if (!tree) {
+                SetError("parse failed");
+                return;
+            }
+            TSNode root = ts_tree_root_node(tree);
+            ParseResult &result = batch->results[i];
+            result.has_error = ts_node_has_error(root);
+            result.node_count = ts_node_descendant_count(root);
+            if (batch->trees) {
+                char *string = ts_node_string(root);
+                result.tree = string;
+                free(string);
+            }
+            ts_tree_delete(tree);
+        }
+    }
+
+    void OnOK() override { Finish(); }
+
+    void OnError(const Napi::Error &error) override {
+        if (batch->error.empty()) {
+            batch->error = error.Message();
+        }
+        Finish();
+    }
+
+  private:
+    // Queues the next work item in place of this one, or settles the promise
+    // once the last one is done. After an error nothing more is queued.
+    void Finish() {
+        Napi::Env env = Env();
+        batch->in_flight--;
+        if (batch->error.empty()) {
+            queue_items(env, batch);
+        }
+        if (batch->in_flight > 0) {
+            return;
+        }
+        if (!batch->error.empty()) {
+            batch->deferred.Reject(Napi::Error::New(env, batch->error).Value());
+            return;
+        }
+        batch->deferred.Resolve(summaries(env, *batch));
+    }
+
+    std::shared_ptr<ParseBatch> batch;
+    size_t begin;
+    size_t end;
+};
+
+// Queues work items until `max_in_flight` of them are queued or every input
+// has been handed out
+void queue_items(Napi::Env env, const std::shared_ptr<ParseBatch> &batch) {
+    size_t count = batch->inputs.size();
+    while (batch->in_flight < batch->max_in_flight && batch->next < count) {
+        size_t begin = batch->next;
+        size_t end = begin + 1;
+        uint64_t bytes = batch->inputs[begin].second;
+        while (end < count && end - begin < ITEM_SOURCES &&
+               bytes + batch->inputs[end].second <= ITEM_BYTES) {
+            bytes += batch->inputs[end].second;
+            end++;
+        }
+        batch->next = end;
+        batch->in_flight++;
+        (new ParseBatchWorker(env, batch, begin, end))->Queue();
+    }
+}
+
+// The number of libuv pool threads
+size_t pool_size() {
+    const char *size = getenv("UV_THREADPOOL_SIZE");
+    long value = size ? strtol(size, nullptr, 10) : 0;
+    return value > 0 ? std::min<size_t>(static_cast<size_t>(value), 1024) : 4;
+}
+
+Napi::Value ParseBatchFunction(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    if (!info[0].IsArray()) {
+        throw Napi::TypeError::New(env, "sources must be an array");
+    }
+    Napi::Array sources = info[0].As<Napi::Array>();
+    bool trees = false;
+    if (info.Length() > 1 && info[1].IsObject()) {
+        trees = info[1].As<Napi::Object>().Get("trees").ToBoolean();
+    }
+
+    auto batch = std::make_shared<ParseBatch>(env, sources, trees);
+    uint32_t count = sources.Length();
+    batch->inputs.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        Napi::Value source = sources.Get(i);
+        const char *data;
+        size_t length;
+        if (source.IsTypedArray()) {
+            Napi::TypedArray view = source.As<Napi::TypedArray>();
+            data = static_cast<const char *>(view.ArrayBuffer().Data()) +
+                   view.ByteOffset();
+            length = view.ByteLength();
+        } else if (source.IsDataView()) {
+            Napi::DataView view = source.As<Napi::DataView>();
+            data = static_cast<const char *>(view.ArrayBuffer().Data()) +
+                   view.ByteOffset();
+            length = view.ByteLength();
+        } else if (source.IsArrayBuffer()) {
+            Napi::ArrayBuffer buffer = source.As<Napi::ArrayBuffer>();
+            data = static_cast<const char *>(buffer.Data());
+            length = buffer.ByteLength();
+        } else {
+            throw Napi::TypeError::New(
+                env, "sources must be Buffers, typed arrays or ArrayBuffers");
+        }
+        if (length > UINT32_MAX) {
+            throw Napi::RangeError::New(env, "source is larger than 4 GiB");
+        }
+        batch->inputs.emplace_back(data, static_cast<uint32_t>(length));
+    }
+    batch->results.resize(count);
+
+    Napi::Promise promise = batch->deferred.Promise();
+    if (count == 0) {
+        batch->deferred.Resolve(summaries(env, *batch));
+        return promise;
+    }
+    // Half of the pool at most, so that file system, DNS and crypto work of
+    // the rest of the process, which shares the pool, is not held up behind
+    // the batch
+    batch->max_in_flight = std::max<size_t>(pool_size() / 2, 1);
+    queue_items(env, batch);
+    return promise;
+}
+
+} // namespace
+
+#endif // TREE_SITTER_ZSH_PARSE_BATCH
+
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
     exports["name"] = Napi::String::New(env, "zsh");
     auto language = Napi::External<TSLanguage>::New(env, tree_sitter_zsh());
     language.TypeTag(&LANGUAGE_TYPE_TAG);
     exports["language"] = language;
+#ifdef TREE_SITTER_ZSH_PARSE_BATCH
+    exports["parseBatch"] =
+        Napi::Function::New(env, ParseBatchFunction, "parseBatch");
+#endif
     return exports;
 }
 
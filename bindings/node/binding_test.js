@@ -7,3 +7,26 @@ test("can load grammar", () => {
   const parser = new Parser();
   assert.doesNotThrow(() => parser.setLanguage(require(".")));
 });
+
+test("compiles the highlight query once", () => {
+  const { highlightsQuery } = require(".");
+  assert.ok(highlightsQuery instanceof Parser.Query);
+  assert.strictEqual(require(".").highlightsQuery, highlightsQuery);
+});
+
+test("can parse a batch", { skip: !require(".").parseBatch }, async () => {
+  const { parseBatch } = require(".");
+  const sources = [
+    Buffer.from("echo ${(U)name}\n"),
+    new TextEncoder().encode("if [[ $a == b ]]; then\n"),
+    new ArrayBuffer(0),
+  ];
+  const summaries = await parseBatch(sources, { trees: true });
+  assert.strictEqual(summaries.length, sources.length);
+  assert.strictEqual(summaries[0].hasError, false);
+  assert.match(summaries[0].tree, /^\(program /);
+  assert.strictEqual(summaries[1].hasError, true);
+  assert.strictEqual(summaries[2].nodeCount, 1);
+  assert.deepStrictEqual(await parseBatch([]), []);
+  assert.throws(() => parseBatch(["echo"]), TypeError);
+});
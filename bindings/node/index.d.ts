@@ -18,10 +18,42 @@ type NodeInfo =
       children: ChildNode[];
     });
 
+type ParseSummary = {
+  hasError: boolean;
+  nodeCount: number;
+  /** The S-expression of the syntax tree, when requested with `trees` */
+  tree?: string;
+};
+
+type ParseBatchOptions = {
+  trees?: boolean;
+};
+
 type Language = {
   name: string;
   language: unknown;
   nodeTypeInfo: NodeInfo[];
+  /**
+   * The highlight query, compiled on first access and shared afterwards.
+   * Requires the tree-sitter package.
+   */
+  readonly highlightsQuery: import("tree-sitter").Query;
+  /**
+   * Parse the sources on the libuv thread pool and resolve to a summary of
+   * each, in order. The memory of the buffers is parsed in place, so it must
+   * not be modified, transferred or detached until the promise settles.
+   *
+   * The sources are parsed in items of up to 64 sources or 1 MiB, on at
+   * most half of the pool threads, so that other users of the pool are not
+   * held up behind a large batch.
+   *
+   * Only present when the binding was built with TREE_SITTER_ZSH_PARSE_BATCH=1,
+   * which links it against the installed tree-sitter runtime.
+   */
+  parseBatch?(
+    sources: (ArrayBufferView | ArrayBuffer)[],
+    options?: ParseBatchOptions,
+  ): Promise<ParseSummary[]>;
 };
 
 declare const language: Language;
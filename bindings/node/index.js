@@ -9,3 +9,18 @@ module.exports =
 try {
   module.exports.nodeTypeInfo = require("../../src/node-types.json");
 } catch (_) {}
+
+let highlightsQuery;
+
+// Compiled on first use, since compiling analyzes every pattern
+Object.defineProperty(module.exports, "highlightsQuery", {
+  get() {
+    if (!highlightsQuery) {
+      const { Query } = require("tree-sitter");
+      const source = require("fs").readFileSync(
+        require("path").join(root, "queries", "highlights.scm"), "utf8");
+      highlightsQuery = new Query(module.exports, source);
+    }
+    return highlightsQuery;
+  },
+});
@@ -1,4 +1,6 @@
-from unittest import TestCase
+import os
+import tempfile
+from unittest import TestCase, skipUnless
 
 import tree_sitter, tree_sitter_zsh
 
@@ -9,3 +11,65 @@ class TestLanguage(TestCase):
             tree_sitter.Language(tree_sitter_zsh.language())
         except Exception:
             self.fail("Error loading Bash grammar")
+
+    def test_queries_are_compiled_once(self):
+        highlights = tree_sitter_zsh.query("highlights")
+        self.assertIsInstance(highlights, tree_sitter.Query)
+        self.assertIs(tree_sitter_zsh.query("highlights"), highlights)
+
+    def test_parses_a_file_in_chunks(self):
+        source = b"for f in *.zsh(N); do print -r -- ${f:t}; done\n" * 100
+        parser = tree_sitter.Parser(
+            tree_sitter.Language(tree_sitter_zsh.language()))
+        with tempfile.TemporaryFile() as file:
+            file.write(source)
+            file.flush()
+            tree = parser.parse(tree_sitter_zsh.file_reader(file, 7))
+        self.assertEqual(str(tree.root_node), str(parser.parse(source).root_node))
+
+    def test_reads_a_file_without_pread(self):
+        with tempfile.TemporaryFile() as file:
+            file.write(b"echo a\necho b\n")
+            file.flush()
+            # as on Windows
+            pread = os.pread
+            del os.pread
+            try:
+                descriptor = tree_sitter_zsh.file_reader(file.fileno(), 4)
+                stream = tree_sitter_zsh.file_reader(file, 4)
+            finally:
+                os.pread = pread
+            self.assertEqual(descriptor(7, (1, 0)), b"echo")
+            self.assertEqual(stream(12, (1, 5)), b"b\n")
+            self.assertEqual(stream(0, (0, 0)), b"echo")
+
+    def test_splits_at_top_level_statements(self):
+        source = b"if true; then\n  echo a\nfi\ncat <<EOF\nx\nEOF\necho b |\n  tr b c\n"
+        self.assertEqual(tree_sitter_zsh.split_points(source, 0), [26, 42])
+        self.assertEqual(tree_sitter_zsh.split_points(source, 30), [42])
+
+    def test_glob_flags_are_not_comments(self):
+        source = b"for f in *.zsh(#qN); do\n  echo $f\ndone\n[[ $x = (#i)foo ]] && echo y\necho b\n"
+        self.assertEqual(tree_sitter_zsh.split_points(source, 0), [39, 68])
+
+
+@skipUnless(hasattr(tree_sitter_zsh, "parse_many"), "built without the runtime")
+class TestParseMany(TestCase):
+    def test_parses_buffers_in_order(self):
+        sources = [b"echo ok\n", bytearray(b"if [[ -n $x ]]; then\n"), b""]
+        results = tree_sitter_zsh.parse_many(sources, threads=2, trees=True)
+        self.assertEqual([has_error for has_error, _, _ in results],
+                         [False, True, False])
+        self.assertTrue(results[0][2].startswith("(program"))
+
+    def test_matches_the_python_parser(self):
+        source = b"for f in *.zsh(N); do print -r -- ${f:t}; done\n"
+        tree = tree_sitter.Parser(
+            tree_sitter.Language(tree_sitter_zsh.language())).parse(source)
+        (has_error, node_count, _), = tree_sitter_zsh.parse_many([source])
+        self.assertEqual(has_error, tree.root_node.has_error)
+        self.assertEqual(node_count, tree.root_node.descendant_count)
+
+    def test_reports_unreadable_paths(self):
+        with self.assertRaises(FileNotFoundError):
+            tree_sitter_zsh.parse_many(["/nonexistent/script.zsh"])
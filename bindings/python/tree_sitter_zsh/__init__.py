@@ -1,8 +1,15 @@
 """Zsh grammar for tree-sitter"""
 
+import os as _os
+from functools import cache as _cache
 from importlib.resources import files as _files
 
-from ._binding import language
+from ._binding import language, split_points
+
+try:
+    from ._binding import parse_many
+except ImportError:  # built without the tree-sitter runtime
+    pass
 
 
 def _get_query(name, file):
@@ -11,6 +18,48 @@ def _get_query(name, file):
     return globals()[name]
 
 
+@_cache
+def query(name):
+    """Compile a query of this package, such as "highlights", once per process.
+
+    Compiling a query analyzes all of its patterns, so code that runs the
+    same queries repeatedly should get them from here instead of compiling
+    the text itself. Requires the tree-sitter package.
+    """
+    from tree_sitter import Language, Query
+
+    text = (_files(f"{__package__}.queries") / f"{name}.scm").read_text()
+    return Query(Language(language()), text)
+
+
+def file_reader(file, chunk_size=64 * 1024):
+    """Return a read callback for tree_sitter.Parser.parse() over a file.
+
+    The file, a binary file object or a descriptor, is read chunk_size bytes
+    at a time at the offsets the parser asks for, so that parsing it does not
+    need its whole contents in memory. The file must stay open until the
+    parse returns. Where os.pread is missing, as on Windows, each read seeks
+    to its offset first, which moves the position of the file.
+    """
+    if hasattr(_os, "pread"):
+        fd = file if isinstance(file, int) else file.fileno()
+
+        def read(byte_offset, _point):
+            return _os.pread(fd, chunk_size, byte_offset)
+    elif isinstance(file, int):
+
+        def read(byte_offset, _point):
+            _os.lseek(file, byte_offset, _os.SEEK_SET)
+            return _os.read(file, chunk_size)
+    else:
+
+        def read(byte_offset, _point):
+            file.seek(byte_offset)
+            return file.read(chunk_size)
+
+    return read
+
+
 def __getattr__(name):
     if name == "HIGHLIGHTS_QUERY":
         return _get_query("HIGHLIGHTS_QUERY", "highlights.scm")
@@ -19,9 +68,14 @@ def __getattr__(name):
 
 
 __all__ = [
+    "file_reader",
     "language",
+    "query",
+    "split_points",
     "HIGHLIGHTS_QUERY",
 ]
+if "parse_many" in globals():
+    __all__.append("parse_many")
 
 
 def __dir__():
@@ -1,5 +1,34 @@
-from typing import Final
+import sys
+from collections.abc import Callable, Iterable
+from os import PathLike
+from typing import Final, Literal, Protocol
+
+from tree_sitter import Query
+from typing_extensions import Buffer
 
 HIGHLIGHTS_QUERY: Final[str]
 
 def language() -> object: ...
+
+def query(name: Literal["highlights"]) -> Query: ...
+
+if sys.platform == "win32":
+    class _ReadableFile(Protocol):
+        def seek(self, offset: int, /) -> object: ...
+        def read(self, size: int, /) -> bytes: ...
+else:
+    class _ReadableFile(Protocol):
+        def fileno(self) -> int: ...
+
+def file_reader(
+    file: _ReadableFile | int, chunk_size: int = 65536
+) -> Callable[[int, tuple[int, int]], bytes]: ...
+
+def split_points(source: bytes, chunk_size: int, /) -> list[int]: ...
+
+def parse_many(
+    sources: Iterable[str | PathLike[str] | Buffer],
+    *,
+    threads: int = 0,
+    trees: bool = False,
+) -> list[tuple[bool, int, str | None]]: ...
@@ -1,14 +1,305 @@
-
+#define PY_SSIZE_T_CLEAN
 #include <Python.h>
 
 typedef struct TSLanguage TSLanguage;
 
 TSLanguage *tree_sitter_zsh(void);
 
+uint32_t tree_sitter_zsh_split_points(const char *source, uint32_t length,
+                                      uint32_t chunk_size, uint32_t *points,
+                                      uint32_t capacity);
+
 static PyObject* _binding_language(PyObject *Py_UNUSED(self), PyObject *Py_UNUSED(args)) {
     return PyCapsule_New(tree_sitter_zsh(), "tree_sitter.Language", NULL);
 }
 
+// Takes bytes rather than any buffer, since the buffer protocol is not
+// in the limited API this module is built against by default
+static PyObject *_binding_split_points(PyObject *Py_UNUSED(self),
+                                       PyObject *args) {
+    const char *source;
+    Py_ssize_t length;
+    unsigned int chunk_size;
+    if (!PyArg_ParseTuple(args, "y#I:split_points", &source, &length,
+                          &chunk_size)) {
+        return NULL;
+    }
+    if ((size_t)length > 0xFFFFFFFF) {
+        PyErr_SetString(PyExc_OverflowError, "source is larger than 4 GiB");
+        return NULL;
+    }
+    // One point per line at most
+    Py_ssize_t capacity = 0;
+    for (Py_ssize_t i = 0; i < length; i++) {
+        capacity += source[i] == '\n';
+    }
+    if (chunk_size > 0 && capacity > length / chunk_size + 1) {
+        capacity = length / chunk_size + 1;
+    }
+    uint32_t *points =
+        PyMem_Malloc((capacity ? (size_t)capacity : 1) * sizeof(*points));
+    if (!points) {
+        return PyErr_NoMemory();
+    }
+    uint32_t count;
+    Py_BEGIN_ALLOW_THREADS
+    count = tree_sitter_zsh_split_points(source, (uint32_t)length, chunk_size,
+                                         points, (uint32_t)capacity);
+    Py_END_ALLOW_THREADS
+    PyObject *result = PyList_New((Py_ssize_t)count);
+    for (uint32_t i = 0; result && i < count; i++) {
+        PyObject *point = PyLong_FromUnsignedLong(points[i]);
+        if (!point) {
+            Py_CLEAR(result);
+            break;
+        }
+        PyList_SetItem(result, (Py_ssize_t)i, point);
+    }
+    PyMem_Free(points);
+    return result;
+}
+
+#ifdef TREE_SITTER_ZSH_PARSE_MANY
+
+// Bulk parsing on native threads, for callers that parse many files and are
+// limited by per-file Python overhead. It is only built when setup.py is run
+// with TREE_SITTER_ZSH_PARSE_MANY=1, and links the installed tree-sitter
+// runtime.
+
+#include <tree_sitter/api.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+    // Input: a file to map, or the memory of a buffer object
+    char *path;
+    Py_buffer view;
+    // Output
+    int error;
+    bool has_error;
+    uint32_t node_count;
+    char *tree;
+} ParseItem;
+
+typedef struct {
+    ParseItem *items;
+    Py_ssize_t count;
+    _Atomic Py_ssize_t next;
+    bool trees;
+} ParseJob;
+
+static void parse_item(TSParser *parser, ParseItem *item, bool trees) {
+    const char *source = item->view.buf;
+    size_t length = (size_t)item->view.len;
+    void *mapping = NULL;
+
+    if (item->path) {
+        int fd = open(item->path, O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            item->error = errno;
+            if (fd >= 0) {
+                close(fd);
+            }
+            return;
+        }
+        length = (size_t)info.st_size;
+        if (length > 0) {
+            mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                item->error = errno;
+                close(fd);
+                return;
+            }
+        }
+        close(fd);
+        source = mapping ? mapping : "";
+    }
+    if (length > UINT32_MAX) {
+        item->error = EFBIG;
+    } else {
+        TSTree *tree =
+            ts_parser_parse_string(parser, NULL, source, (uint32_t)length);
+        TSNode root = ts_tree_root_node(tree);
+        item->has_error = ts_node_has_error(root);
+        item->node_count = ts_node_descendant_count(root);
+        if (trees) {
+            item->tree = ts_node_string(root);
+        }
+        ts_tree_delete(tree);
+    }
+    if (mapping) {
+        munmap(mapping, length);
+    }
+}
+
+static void *parse_worker(void *payload) {
+    ParseJob *job = payload;
+    TSParser *parser = ts_parser_new();
+    ts_parser_set_language(parser, tree_sitter_zsh());
+    for (;;) {
+        Py_ssize_t index = atomic_fetch_add(&job->next, 1);
+        if (index >= job->count) {
+            break;
+        }
+        parse_item(parser, &job->items[index], job->trees);
+    }
+    ts_parser_delete(parser);
+    return NULL;
+}
+
+// Runs the job on `threads` threads, including the calling one
+static void run_parse_job(ParseJob *job, long threads) {
+    pthread_t *workers = calloc((size_t)threads, sizeof(pthread_t));
+    long started = 0;
+    while (workers && started < threads - 1 &&
+           pthread_create(&workers[started], NULL, parse_worker, job) == 0) {
+        started++;
+    }
+    parse_worker(job);
+    for (long i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+}
+
+static void release_items(ParseItem *items, Py_ssize_t count) {
+    for (Py_ssize_t i = 0; i < count; i++) {
+        if (items[i].path) {
+            PyMem_RawFree(items[i].path);
+        } else if (items[i].view.obj) {
+            PyBuffer_Release(&items[i].view);
+        }
+        free(items[i].tree);
+    }
+    PyMem_RawFree(items);
+}
+
+// Takes a path from a str or os.PathLike, and the memory of anything else
+static int init_item(ParseItem *item, PyObject *source) {
+    if (PyUnicode_Check(source) || PyObject_HasAttrString(source, "__fspath__")) {
+        PyObject *encoded = NULL;
+        if (!PyUnicode_FSConverter(source, &encoded)) {
+            return -1;
+        }
+        const char *path = PyBytes_AS_STRING(encoded);
+        item->path = PyMem_RawMalloc(strlen(path) + 1);
+        if (item->path) {
+            strcpy(item->path, path);
+        }
+        Py_DECREF(encoded);
+        if (!item->path) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        return 0;
+    }
+    return PyObject_GetBuffer(source, &item->view, PyBUF_SIMPLE);
+}
+
+static PyObject *build_results(PyObject *sources, ParseItem *items,
+                               Py_ssize_t count) {
+    PyObject *results = PyList_New(count);
+    if (!results) {
+        return NULL;
+    }
+    for (Py_ssize_t i = 0; i < count; i++) {
+        ParseItem *item = &items[i];
+        if (item->error) {
+            errno = item->error;
+            PyErr_SetFromErrnoWithFilenameObject(
+                PyExc_OSError, PySequence_Fast_GET_ITEM(sources, i));
+            Py_DECREF(results);
+            return NULL;
+        }
+        PyObject *tree = Py_None;
+        if (item->tree) {
+            tree = PyUnicode_FromString(item->tree);
+            if (!tree) {
+                Py_DECREF(results);
+                return NULL;
+            }
+        } else {
+            Py_INCREF(tree);
+        }
+        PyObject *result =
+            Py_BuildValue("(NIN)", PyBool_FromLong(item->has_error),
+                          (unsigned int)item->node_count, tree);
+        if (!result) {
+            Py_DECREF(results);
+            return NULL;
+        }
+        PyList_SET_ITEM(results, i, result);
+    }
+    return results;
+}
+
+static PyObject *_binding_parse_many(PyObject *Py_UNUSED(self), PyObject *args,
+                                     PyObject *kwargs) {
+    static char *keywords[] = {"sources", "threads", "trees", NULL};
+    PyObject *iterable;
+    long threads = 0;
+    int trees = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|$lp:parse_many",
+                                     keywords, &iterable, &threads, &trees)) {
+        return NULL;
+    }
+    if (threads < 0) {
+        PyErr_SetString(PyExc_ValueError, "threads must not be negative");
+        return NULL;
+    }
+    PyObject *sources =
+        PySequence_Fast(iterable, "sources must be an iterable");
+    if (!sources) {
+        return NULL;
+    }
+
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(sources);
+    ParseItem *items = PyMem_RawCalloc(count ? (size_t)count : 1,
+                                       sizeof(ParseItem));
+    if (!items) {
+        Py_DECREF(sources);
+        return PyErr_NoMemory();
+    }
+    for (Py_ssize_t i = 0; i < count; i++) {
+        if (init_item(&items[i], PySequence_Fast_GET_ITEM(sources, i)) < 0) {
+            release_items(items, count);
+            Py_DECREF(sources);
+            return NULL;
+        }
+    }
+
+    if (threads == 0) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads > count) {
+        threads = (long)count;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    ParseJob job = {items, count, 0, trees};
+    Py_BEGIN_ALLOW_THREADS
+    run_parse_job(&job, threads);
+    Py_END_ALLOW_THREADS
+
+    PyObject *results = build_results(sources, items, count);
+    release_items(items, count);
+    Py_DECREF(sources);
+    return results;
+}
+
+#endif // TREE_SITTER_ZSH_PARSE_MANY
+
 static struct PyModuleDef_Slot slots[] = {
 #ifdef Py_GIL_DISABLED
     {Py_mod_gil, Py_MOD_GIL_NOT_USED},
@@ -19,6 +310,28 @@ static struct PyModuleDef_Slot slots[] = {
 static PyMethodDef methods[] = {
     {"language", _binding_language, METH_NOARGS,
      "Get the tree-sitter language for this grammar."},
+    {"split_points", _binding_split_points, METH_VARARGS,
+     "split_points(source, chunk_size, /)\n"
+     "--\n\n"
+     "Find where the bytes of a script can be cut to parse it in pieces.\n\n"
+     "Returns the offsets of the line starts, excluding 0, at which a\n"
+     "top-level statement begins, each the first one at least chunk_size bytes\n"
+     "past the previous one, or all of them when chunk_size is 0. The pieces\n"
+     "between them can be parsed separately, e.g. by passing memoryview slices\n"
+     "of the source to parse_many(). Stops early at anything it cannot follow."},
+#ifdef TREE_SITTER_ZSH_PARSE_MANY
+    {"parse_many", (PyCFunction)(void (*)(void))_binding_parse_many,
+     METH_VARARGS | METH_KEYWORDS,
+     "parse_many(sources, *, threads=0, trees=False)\n"
+     "--\n\n"
+     "Parse files and buffers on native threads without holding the GIL.\n\n"
+     "Each source is a path, as a str or os.PathLike, which is memory-mapped,\n"
+     "or an object supporting the buffer protocol, which is parsed in place\n"
+     "and must not be resized meanwhile. threads=0 uses one thread per CPU.\n"
+     "Returns a (has_error, node_count, tree) tuple per source, where tree is\n"
+     "the S-expression of the syntax tree when trees is true and None\n"
+     "otherwise. Raises OSError for the first path that cannot be read."},
+#endif
     {NULL, NULL, 0, NULL}
 };
 
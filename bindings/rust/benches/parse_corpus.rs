@@ -0,0 +1,94 @@
+//! The scaling of `parse_corpus` with the number of rayon threads.
+//!
+//! Parses the files of `test/corpus`, `examples` and `bench` once per
+//! iteration on pools of 1, 2, 4, ... threads up to the number of CPUs.
+//! The corpus files are parsed whole, headers included, as a stand-in for
+//! a tree of scripts; only the relative times between thread counts matter.
+//!
+//! `parse_forest` does the same for one large file, `bench/install.sh`
+//! repeated to about 16 MiB, against a single-threaded parse of it whole.
+
+use std::path::{Path, PathBuf};
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+
+fn corpus_paths() -> Vec<PathBuf> {
+    let root = Path::new(env!("CARGO_MANIFEST_DIR"));
+    let mut paths = Vec::new();
+    for dir in ["test/corpus", "examples", "bench"] {
+        let Ok(entries) = std::fs::read_dir(root.join(dir)) else {
+            continue;
+        };
+        for entry in entries.flatten() {
+            let path = entry.path();
+            let extension = path.extension().and_then(|e| e.to_str());
+            if matches!(extension, Some("txt" | "sh" | "zsh")) {
+                paths.push(path);
+            }
+        }
+    }
+    paths.sort();
+    paths
+}
+
+fn parse_corpus(c: &mut Criterion) {
+    let paths = corpus_paths();
+    let bytes: u64 = paths
+        .iter()
+        .map(|path| std::fs::metadata(path).map_or(0, |m| m.len()))
+        .sum();
+
+    let mut group = c.benchmark_group("parse_corpus");
+    group.throughput(Throughput::Bytes(bytes));
+    for threads in thread_counts() {
+        let pool = rayon::ThreadPoolBuilder::new()
+            .num_threads(threads)
+            .build()
+            .unwrap();
+        group.bench_with_input(BenchmarkId::from_parameter(threads), &paths, |b, paths| {
+            b.iter(|| pool.install(|| tree_sitter_zsh::parse_corpus(paths)));
+        });
+    }
+    group.finish();
+}
+
+fn parse_forest(c: &mut Criterion) {
+    let root = Path::new(env!("CARGO_MANIFEST_DIR"));
+    let script = std::fs::read(root.join("bench/install.sh")).unwrap();
+    let source = script.repeat((16 << 20) / script.len().max(1) + 1);
+
+    let mut group = c.benchmark_group("parse_forest");
+    group.throughput(Throughput::Bytes(source.len() as u64));
+    group.sample_size(10);
+    group.bench_function("whole", |b| {
+        let mut parser = tree_sitter_zsh::ZshParser::new();
+        b.iter(|| parser.parse(&source, None));
+    });
+    for threads in thread_counts() {
+        let pool = rayon::ThreadPoolBuilder::new()
+            .num_threads(threads)
+            .build()
+            .unwrap();
+        let chunk_size = source.len() / (threads * 4);
+        group.bench_with_input(
+            BenchmarkId::from_parameter(threads),
+            &source,
+            |b, source| {
+                b.iter(|| pool.install(|| tree_sitter_zsh::parse_forest(source, chunk_size)));
+            },
+        );
+    }
+    group.finish();
+}
+
+fn thread_counts() -> Vec<usize> {
+    let cpus = std::thread::available_parallelism().map_or(1, |n| n.get());
+    let mut threads: Vec<usize> = std::iter::successors(Some(1), |n| Some(n * 2))
+        .take_while(|&n| n < cpus)
+        .collect();
+    threads.push(cpus);
+    threads
+}
+
+criterion_group!(benches, parse_corpus, parse_forest);
+criterion_main!(benches);
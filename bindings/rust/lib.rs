@@ -18,13 +18,34 @@
 //! assert!(!tree.root_node().has_error());
 //! ```
 //!
+//! With the `pool` feature, [`ZshParser`] keeps a parser set up for reuse and
+//! [`parse_corpus`] parses many files in parallel on the rayon thread pool,
+//! while [`parse_forest`] parses one large file in pieces cut by
+//! [`split_points`].
+//!
 //! [Parser]: https://docs.rs/tree-sitter/*/tree_sitter/struct.Parser.html
 //! [tree-sitter]: https://tree-sitter.github.io/
 
 use tree_sitter_language::LanguageFn;
 
+#[cfg(feature = "pool")]
+mod pool;
+
+#[cfg(feature = "pool")]
+pub use pool::{
+    parse_corpus, parse_corpus_with, parse_forest, ParseSummary, ParserPool, PooledParser,
+    ZshParser,
+};
+
 extern "C" {
     fn tree_sitter_zsh() -> *const ();
+    fn tree_sitter_zsh_split_points(
+        source: *const u8,
+        length: u32,
+        chunk_size: u32,
+        points: *mut u32,
+        capacity: u32,
+    ) -> u32;
 }
 
 /// The tree-sitter [`LanguageFn`][LanguageFn] for this grammar.
@@ -40,6 +61,52 @@ pub const NODE_TYPES: &str = include_str!("../../src/node-types.json");
 /// The syntax highlighting query for this grammar.
 pub const HIGHLIGHT_QUERY: &str = include_str!("../../queries/highlights.scm");
 
+/// [`HIGHLIGHT_QUERY`], compiled on first use and shared afterwards.
+///
+/// Compiling a query analyzes all of its patterns, so programs that
+/// highlight repeatedly should use this rather than compiling the text.
+#[cfg(feature = "query")]
+pub fn highlight_query() -> &'static tree_sitter::Query {
+    static QUERY: std::sync::OnceLock<tree_sitter::Query> = std::sync::OnceLock::new();
+    QUERY.get_or_init(|| {
+        tree_sitter::Query::new(&LANGUAGE.into(), HIGHLIGHT_QUERY)
+            .expect("Error compiling the highlight query")
+    })
+}
+
+/// Find where `source` can be cut into pieces that parse independently.
+///
+/// Returns the byte offsets of the line starts, excluding 0, at which a
+/// top-level statement begins, each the first one at least `chunk_size` bytes
+/// past the previous one, or all of them when `chunk_size` is 0. No quote,
+/// bracket, compound command, heredoc or pipeline is open before them. The
+/// scan stops early at anything it cannot follow, so the last piece may be
+/// larger than asked for.
+///
+/// # Panics
+///
+/// Panics if `source` is 4 GiB or larger.
+pub fn split_points(source: &[u8], chunk_size: usize) -> Vec<usize> {
+    let length = u32::try_from(source.len()).expect("source is larger than 4 GiB");
+    let lines = source.iter().filter(|&&b| b == b'\n').count();
+    let capacity = match chunk_size {
+        0 => lines,
+        _ => lines.min(source.len() / chunk_size + 1),
+    };
+    let mut points = vec![0u32; capacity];
+    let count = unsafe {
+        tree_sitter_zsh_split_points(
+            source.as_ptr(),
+            length,
+            u32::try_from(chunk_size).unwrap_or(u32::MAX),
+            points.as_mut_ptr(),
+            capacity as u32,
+        )
+    };
+    points.truncate(count as usize);
+    points.into_iter().map(|point| point as usize).collect()
+}
+
 #[cfg(test)]
 mod tests {
     #[test]
@@ -49,4 +116,27 @@ mod tests {
             .set_language(&super::LANGUAGE.into())
             .expect("Error loading Bash parser");
     }
+
+    #[test]
+    fn test_split_points() {
+        let source = b"if true; then\n  echo a\nfi\ncat <<EOF\nx\nEOF\necho b |\n  tr b c\n";
+        assert_eq!(super::split_points(source, 0), [26, 42]);
+        assert_eq!(super::split_points(source, 30), [42]);
+        assert!(super::split_points(b"", 0).is_empty());
+    }
+
+    #[test]
+    fn test_split_points_after_glob_flags() {
+        let source =
+            b"for f in *.zsh(#qN); do\n  echo $f\ndone\n[[ $x = (#i)foo ]] && echo y\necho b\n";
+        assert_eq!(super::split_points(source, 0), [39, 68]);
+    }
+
+    #[cfg(feature = "query")]
+    #[test]
+    fn test_highlight_query_is_shared() {
+        let query = super::highlight_query();
+        assert!(query.pattern_count() > 0);
+        assert!(std::ptr::eq(query, super::highlight_query()));
+    }
 }
@@ -0,0 +1,350 @@
+//! Parser reuse and parallel parsing, behind the `pool` feature.
+//!
+//! Setting up a parser allocates its stacks, lexer and the external scanner;
+//! reusing one keeps all of that warm, so parsing many files should go
+//! through a [`ZshParser`] per thread rather than a new [`Parser`] per file.
+
+use std::cell::{Cell, RefCell};
+use std::fs::File;
+use std::io;
+use std::path::Path;
+use std::sync::Mutex;
+
+use memmap2::Mmap;
+use rayon::prelude::*;
+use tree_sitter::{Parser, Tree};
+
+/// A [`Parser`] with this grammar's language already set.
+///
+/// Its parse stack, lexer and external scanner are created once and reused
+/// by every parse, so keep one around instead of building one per file.
+pub struct ZshParser {
+    parser: Parser,
+}
+
+impl ZshParser {
+    /// Create a parser for this grammar.
+    pub fn new() -> Self {
+        let mut parser = Parser::new();
+        parser
+            .set_language(&crate::LANGUAGE.into())
+            .expect("Error loading Zsh parser");
+        Self { parser }
+    }
+
+    /// Parse `source`, reusing `old_tree` if it was edited to match it.
+    pub fn parse(&mut self, source: impl AsRef<[u8]>, old_tree: Option<&Tree>) -> Tree {
+        self.parser
+            .parse(source, old_tree)
+            .expect("parse without a timeout or cancellation flag failed")
+    }
+
+    /// Parse `file` from its start, reading `chunk_size` bytes at a time.
+    ///
+    /// Only the chunk being lexed is held in memory, which suits files too
+    /// large to read whole or to map. Returns the first read error, if any.
+    pub fn parse_file(&mut self, file: &File, chunk_size: usize) -> io::Result<Tree> {
+        let chunk_size = chunk_size.max(1);
+        let spare = Cell::new(None);
+        let mut error = None;
+        let tree = self
+            .parser
+            .parse_with_options(
+                &mut |offset, _| {
+                    let mut bytes: Vec<u8> = spare.take().unwrap_or_default();
+                    // Only the part past a short read is zeroed again
+                    bytes.resize(chunk_size, 0);
+                    if error.is_none() {
+                        match read_at(file, &mut bytes, offset as u64) {
+                            Ok(size) => bytes.truncate(size),
+                            Err(e) => error = Some(e),
+                        }
+                    }
+                    if error.is_some() {
+                        bytes.clear();
+                    }
+                    Chunk {
+                        bytes,
+                        spare: &spare,
+                    }
+                },
+                None,
+                None,
+            )
+            .expect("parse without a timeout or cancellation flag failed");
+        match error {
+            Some(error) => Err(error),
+            None => Ok(tree),
+        }
+    }
+
+    /// The underlying parser, e.g. to set included ranges or a logger.
+    pub fn parser(&mut self) -> &mut Parser {
+        &mut self.parser
+    }
+
+    /// Run `f` with the calling thread's parser, creating it on first use.
+    ///
+    /// This is how [`parse_corpus_with`] keeps one parser per rayon worker.
+    /// `f` must not call `with_thread_parser` itself.
+    pub fn with_thread_parser<R>(f: impl FnOnce(&mut ZshParser) -> R) -> R {
+        thread_local! {
+            static PARSER: RefCell<Option<ZshParser>> = const { RefCell::new(None) };
+        }
+        PARSER.with(|parser| {
+            let mut parser = parser.borrow_mut();
+            f(parser.get_or_insert_with(ZshParser::new))
+        })
+    }
+}
+
+/// A chunk read by [`ZshParser::parse_file`].
+///
+/// The runtime holds on to each chunk until it asks for the next one, so the
+/// buffer cannot be borrowed from the read callback; instead it is handed back
+/// through `spare` when the chunk is dropped, and the callback reads into it
+/// again. Two buffers end up in use, however many chunks are read.
+struct Chunk<'a> {
+    bytes: Vec<u8>,
+    spare: &'a Cell<Option<Vec<u8>>>,
+}
+
+impl AsRef<[u8]> for Chunk<'_> {
+    fn as_ref(&self) -> &[u8] {
+        &self.bytes
+    }
+}
+
+impl Drop for Chunk<'_> {
+    fn drop(&mut self) {
+        self.spare.set(Some(std::mem::take(&mut self.bytes)));
+    }
+}
+
+#[cfg(unix)]
+fn read_at(file: &File, buffer: &mut [u8], offset: u64) -> io::Result<usize> {
+    std::os::unix::fs::FileExt::read_at(file, buffer, offset)
+}
+
+#[cfg(windows)]
+fn read_at(file: &File, buffer: &mut [u8], offset: u64) -> io::Result<usize> {
+    std::os::windows::fs::FileExt::seek_read(file, buffer, offset)
+}
+
+impl Default for ZshParser {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// A pool of [`ZshParser`]s shared between threads.
+///
+/// [`get`](Self::get) hands out an idle parser, or a new one when all are in
+/// use, and takes it back when the guard is dropped. The pool never holds
+/// more parsers than were in use at the same time.
+#[derive(Default)]
+pub struct ParserPool {
+    idle: Mutex<Vec<ZshParser>>,
+}
+
+impl ParserPool {
+    /// Create an empty pool.
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Take a parser out of the pool until the guard is dropped.
+    pub fn get(&self) -> PooledParser<'_> {
+        let parser = self.idle.lock().unwrap_or_else(|e| e.into_inner()).pop();
+        PooledParser {
+            pool: self,
+            parser: Some(parser.unwrap_or_default()),
+        }
+    }
+}
+
+/// A parser borrowed from a [`ParserPool`].
+pub struct PooledParser<'a> {
+    pool: &'a ParserPool,
+    parser: Option<ZshParser>,
+}
+
+impl std::ops::Deref for PooledParser<'_> {
+    type Target = ZshParser;
+
+    fn deref(&self) -> &ZshParser {
+        self.parser.as_ref().unwrap()
+    }
+}
+
+impl std::ops::DerefMut for PooledParser<'_> {
+    fn deref_mut(&mut self) -> &mut ZshParser {
+        self.parser.as_mut().unwrap()
+    }
+}
+
+impl Drop for PooledParser<'_> {
+    fn drop(&mut self) {
+        if let Some(parser) = self.parser.take() {
+            self.pool
+                .idle
+                .lock()
+                .unwrap_or_else(|e| e.into_inner())
+                .push(parser);
+        }
+    }
+}
+
+/// The outcome of parsing one file with [`parse_corpus`].
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct ParseSummary {
+    /// The length of the file in bytes.
+    pub bytes: usize,
+    /// Whether the tree contains errors or missing nodes.
+    pub has_error: bool,
+    /// The number of nodes in the tree, including the root.
+    pub node_count: usize,
+}
+
+/// Parse every file in `paths` on the current rayon pool and summarize it.
+///
+/// The results are in the order of `paths`.
+pub fn parse_corpus<P: AsRef<Path> + Sync>(paths: &[P]) -> Vec<io::Result<ParseSummary>> {
+    parse_corpus_with(paths, |_, source, tree| {
+        let root = tree.root_node();
+        ParseSummary {
+            bytes: source.len(),
+            has_error: root.has_error(),
+            node_count: root.descendant_count(),
+        }
+    })
+}
+
+/// Parse every file in `paths` on the current rayon pool and map its tree.
+///
+/// Each file is memory-mapped and parsed with its worker's
+/// [`ZshParser::with_thread_parser`] parser, then handed to `f` with its
+/// source, which is unmapped once `f` returns. The results are in the order
+/// of `paths`; a file that cannot be read yields its error. Files must not
+/// be truncated while they are being parsed.
+pub fn parse_corpus_with<P, T, F>(paths: &[P], f: F) -> Vec<io::Result<T>>
+where
+    P: AsRef<Path> + Sync,
+    T: Send,
+    F: Fn(&Path, &[u8], Tree) -> T + Sync,
+{
+    paths
+        .par_iter()
+        .map(|path| {
+            let path = path.as_ref();
+            let file = File::open(path)?;
+            // Empty files cannot be mapped
+            let map = if file.metadata()?.len() > 0 {
+                Some(unsafe { Mmap::map(&file)? })
+            } else {
+                None
+            };
+            let source = map.as_deref().unwrap_or_default();
+            let tree = ZshParser::with_thread_parser(|parser| parser.parse(source, None));
+            Ok(f(path, source, tree))
+        })
+        .collect()
+}
+
+/// Parse one large `source` in parallel, in pieces cut by [`split_points`].
+///
+/// The pieces are at least `chunk_size` bytes, except possibly the last, and
+/// are parsed on the current rayon pool with the workers' thread parsers.
+/// Returns the offset of each piece in `source` with its tree, in order;
+/// node positions in a tree are relative to its piece.
+///
+/// [`split_points`]: crate::split_points
+pub fn parse_forest(source: &[u8], chunk_size: usize) -> Vec<(usize, Tree)> {
+    let mut starts = crate::split_points(source, chunk_size);
+    starts.insert(0, 0);
+    let ends: Vec<usize> = starts[1..].iter().copied().chain([source.len()]).collect();
+    starts
+        .par_iter()
+        .zip(ends.par_iter())
+        .map(|(&start, &end)| {
+            let tree =
+                ZshParser::with_thread_parser(|parser| parser.parse(&source[start..end], None));
+            (start, tree)
+        })
+        .collect()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_pool_reuses_parsers() {
+        // The guards are moved around by value, so the parsers are told apart
+        // by a marker kept in the runtime's own parser
+        let marker = [tree_sitter::Range {
+            start_byte: 0,
+            end_byte: 1,
+            start_point: tree_sitter::Point::new(0, 0),
+            end_point: tree_sitter::Point::new(0, 1),
+        }];
+        let pool = ParserPool::new();
+        pool.get().parser().set_included_ranges(&marker).unwrap();
+        assert_eq!(pool.get().parser().included_ranges(), marker);
+        let (mut a, mut b) = (pool.get(), pool.get());
+        assert_eq!(a.parser().included_ranges(), marker);
+        assert_ne!(b.parser().included_ranges(), marker);
+    }
+
+    #[test]
+    fn test_parse_file_in_chunks() {
+        let path = std::env::temp_dir().join(format!("tree-sitter-zsh-{}.zsh", std::process::id()));
+        let source = "for f in *.zsh(N); do print -r -- ${f:t}; done\n".repeat(100);
+        std::fs::write(&path, &source).unwrap();
+        let file = File::open(&path).unwrap();
+        let mut parser = ZshParser::new();
+        let tree = parser.parse_file(&file, 7).unwrap();
+        std::fs::remove_file(&path).unwrap();
+        assert_eq!(
+            tree.root_node().to_sexp(),
+            parser.parse(&source, None).root_node().to_sexp()
+        );
+    }
+
+    #[test]
+    fn test_parse_forest() {
+        let source = "f() {\n  echo ${1:-x}\n}\ncat <<EOF\n(\nEOF\n".repeat(50);
+        let forest = parse_forest(source.as_bytes(), 100);
+        assert!(forest.len() > 1);
+        assert_eq!(forest[0].0, 0);
+        for (_, tree) in &forest {
+            assert!(!tree.root_node().has_error());
+        }
+    }
+
+    #[test]
+    fn test_parse_corpus() {
+        let dir = std::env::temp_dir().join(format!("tree-sitter-zsh-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let good = dir.join("good.zsh");
+        let bad = dir.join("bad.zsh");
+        let empty = dir.join("empty.zsh");
+        std::fs::write(&good, "echo ${(U)name}\n").unwrap();
+        std::fs::write(&bad, "if [[ $a == b ]]; then\n").unwrap();
+        std::fs::write(&empty, "").unwrap();
+        let missing = dir.join("missing.zsh");
+
+        let results = parse_corpus(&[&good, &bad, &empty, &missing]);
+        std::fs::remove_dir_all(&dir).unwrap();
+
+        let summaries: Vec<_> = results[..3].iter().map(|r| *r.as_ref().unwrap()).collect();
+        assert_eq!(summaries[0].bytes, 16);
+        assert!(!summaries[0].has_error);
+        assert!(summaries[1].has_error);
+        assert_eq!(summaries[2].node_count, 1);
+        assert_eq!(
+            results[3].as_ref().unwrap_err().kind(),
+            io::ErrorKind::NotFound
+        );
+    }
+}
@@ -9,6 +9,13 @@
 /// <reference types="tree-sitter-cli/dsl" />
 // @ts-check
 
+// With TREE_SITTER_ZSH_DIALECT=posix the grammar is generated without the zsh
+// extensions, as the zsh_posix language for tools that only need
+// POSIX and bash-shaped parsing. The externals are the same in both dialects,
+// so that src/scanner.c serves both.
+const DIALECT = process.env.TREE_SITTER_ZSH_DIALECT || 'zsh';
+const ZSH = DIALECT === 'zsh';
+
 const SPECIAL_CHARACTERS = [
   '\'', '"',
   '<', '>',
@@ -134,7 +141,7 @@ function createBinaryExpression(operatorTable, leftField, rightField, options =
 }
 
 module.exports = grammar({
-  name: 'zsh',
+  name: ZSH ? 'zsh' : 'zsh_posix',
 
   conflicts: $ => [
     [$._expression, $.command_name],
@@ -708,7 +715,7 @@ module.exports = grammar({
     subscript: $ => prec.left(seq(
       field('name', $.variable_name),
       '[',
-      optional(field('flags', $.zsh_array_subscript_flags)),
+      ...zshOnly(optional(field('flags', $.zsh_array_subscript_flags))),
       field('index', choice($._param_arithmetic_expression, $.array_star, $.array_at, $.string)),
       ']',
     )),
@@ -972,7 +979,7 @@ module.exports = grammar({
     ),
 
     _primary_expression: $ => choice(
-      $.qualified_expression,    // qualified globs should be first
+      ...zshOnly($.qualified_expression), // qualified globs should be first
       $._expansion_or_variable,
       $.glob_pattern,
       $.word,
@@ -1056,19 +1063,19 @@ module.exports = grammar({
     glob_pattern: $ => prec.dynamic(-1, prec.right(choice(
       // True glob patterns with wildcards
       seq(
-        optional(field('flags', $.zsh_extended_glob_flags)),
+        ...zshOnly(optional(field('flags', $.zsh_extended_glob_flags))),
         field('pattern', $._glob_innards),
-        optional(choice(
+        ...zshOnly(optional(choice(
           prec.right(field('qualifier', $.zsh_glob_qualifier)),
           prec.right(field('modifier', $.zsh_glob_modifier)),
           seq(
             prec.right(field('qualifier', $.zsh_glob_qualifier)),
             prec.right(field('modifier', $.zsh_glob_modifier)),
           ),
-        )),
+        ))),
       ),
       // Words with qualifiers/modifiers (like /path/file(:h))
-      prec(1, seq(
+      ...zshOnly(prec(1, seq(
         optional(field('flags', $.zsh_extended_glob_flags)),
         field('pattern', $.word),
         choice(
@@ -1079,7 +1086,7 @@ module.exports = grammar({
             prec.right(field('modifier', $.zsh_glob_modifier)),
           ),
         ),
-      )),
+      ))),
     ))),
     
 
@@ -1222,17 +1229,17 @@ module.exports = grammar({
     _variable_ref: $ => prec.right(40, seq(
       choice(
         seq(
-            optional($.expansion_style),
+            ...zshOnly(optional($.expansion_style)),
             $._special_variable_name,
         ),
         seq(
-            optional($.expansion_style),
+            ...zshOnly(optional($.expansion_style)),
             $._simple_variable_name,
         ),
       ),
       optional(seq(
         '[',
-        optional(field('flags', $.zsh_array_subscript_flags)),
+        ...zshOnly(optional(field('flags', $.zsh_array_subscript_flags))),
         field('index', choice($._param_arithmetic_expression, $.array_star, $.array_at)),
         ']'
       )),
@@ -1256,7 +1263,7 @@ module.exports = grammar({
       ),
       optional(seq(  // Postfix subscript operator (left-associating)
         '[',
-        optional(field('flags', $.zsh_array_subscript_flags)),
+        ...zshOnly(optional(field('flags', $.zsh_array_subscript_flags))),
         field('index', choice($._param_arithmetic_expression, $.array_star, $.array_at)),
         ']'
       ))
@@ -1391,10 +1398,12 @@ module.exports = grammar({
     expansion: $ => seq(
       prec(2, alias(seq($._bare_dollar, $._brace_start), "${")),
       choice(
-        prec.right(10, seq(field('style', $.expansion_style), 
-             field('flags', $.expansion_flags), $._expansion_body)),
-        prec.right(10, seq(field('style', $.expansion_style), $._expansion_body)),
-        prec.left(10, seq(field('flags', $.expansion_flags), $._expansion_body)),
+        ...zshOnly(
+          prec.right(10, seq(field('style', $.expansion_style), 
+               field('flags', $.expansion_flags), $._expansion_body)),
+          prec.right(10, seq(field('style', $.expansion_style), $._expansion_body)),
+          prec.left(10, seq(field('flags', $.expansion_flags), $._expansion_body)),
+        ),
         prec.left($._expansion_body),
       ),
       '}',
@@ -1879,6 +1888,18 @@ module.exports = grammar({
   },
 });
 
+/**
+ * Returns the rules to splice into a seq or choice when generating the zsh
+ * dialect, and none otherwise.
+ *
+ * @param  {...RuleOrLiteral} rules
+ *
+ * @returns {RuleOrLiteral[]}
+ */
+function zshOnly(...rules) {
+  return ZSH ? rules : [];
+}
+
 /**
  * Returns a regular expression that matches any character except the ones
  * provided.
@@ -1,5 +1,7 @@
-from os import path
+from os import environ, path
 from platform import system
+from shutil import which
+from subprocess import run
 from sysconfig import get_config_var
 
 from setuptools import Extension, find_packages, setup
@@ -18,13 +20,61 @@ macros: list[tuple[str, str | None]] = [
     ("PY_SSIZE_T_CLEAN", None),
     ("TREE_SITTER_HIDE_SYMBOLS", None),
 ]
-if limited_api := not get_config_var("Py_GIL_DISABLED"):
+
+
+def runtime_flags():
+    """The pkg-config flags of the tree-sitter runtime, for parse_many()."""
+    if environ.get("TREE_SITTER_ZSH_PARSE_MANY") != "1":
+        return None
+    pkg_config = environ.get("PKG_CONFIG", "pkg-config")
+    if system() == "Windows" or not which(pkg_config):
+        raise SystemExit("TREE_SITTER_ZSH_PARSE_MANY=1 needs pkg-config")
+    result = run(
+        [pkg_config, "--cflags", "--libs", "tree-sitter"],
+        capture_output=True,
+        text=True,
+        check=False,
+    )
+    if result.returncode != 0:
+        raise SystemExit("TREE_SITTER_ZSH_PARSE_MANY=1 needs the tree-sitter "
+                         "runtime, which pkg-config cannot find:\n"
+                         + result.stderr)
+    return result.stdout.split()
+
+
+# parse_many() is only built with TREE_SITTER_ZSH_PARSE_MANY=1. It links the
+# extension against the tree-sitter runtime found by pkg-config, which then
+# has to be installed wherever the extension is used, so the wheels published
+# for the package are built without it. It also needs the buffer protocol,
+# which the limited API of Python 3.10 lacks, so such builds are not abi3.
+parse_many_flags = runtime_flags()
+if parse_many_flags is not None:
+    macros.append(("TREE_SITTER_ZSH_PARSE_MANY", None))
+
+limited_api = not get_config_var("Py_GIL_DISABLED") and parse_many_flags is None
+if limited_api:
     macros.append(("Py_LIMITED_API", "0x030A0000"))
 
 if system() != "Windows":
     cflags = ["-std=c11", "-fvisibility=hidden"]
 else:
     cflags = ["/std:c11", "/utf-8"]
+include_dirs = ["src"]
+library_dirs = []
+libraries = []
+link_args = []
+if parse_many_flags is not None:
+    cflags.append("-pthread")
+    link_args.append("-pthread")
+for flag in parse_many_flags or []:
+    if flag.startswith("-I"):
+        include_dirs.append(flag[2:])
+    elif flag.startswith("-L"):
+        library_dirs.append(flag[2:])
+    elif flag.startswith("-l"):
+        libraries.append(flag[2:])
+    else:
+        cflags.append(flag)
 
 
 class Build(build):
@@ -38,7 +88,7 @@ class Build(build):
 class BdistWheel(bdist_wheel):
     def get_tag(self):
         python, abi, platform = super().get_tag()
-        if python.startswith("cp"):
+        if python.startswith("cp") and limited_api:
             python, abi = "cp310", "abi3"
         return python, abi, platform
 
@@ -64,7 +114,10 @@ setup(
             sources=sources,
             extra_compile_args=cflags,
             define_macros=macros,
-            include_dirs=["src"],
+            include_dirs=include_dirs,
+            library_dirs=library_dirs,
+            libraries=libraries,
+            extra_link_args=link_args,
             py_limited_api=limited_api,
         )
     ],
@@ -10,6 +10,26 @@
 
 #define DEBUG 0
 
+// The zsh_posix language, generated with TREE_SITTER_ZSH_DIALECT=posix, is
+// built from this same scanner with TREE_SITTER_ZSH_POSIX. Its grammar never
+// makes the zsh-only tokens valid, so scanning them is compiled out, and the
+// exported functions take its name.
+#ifdef TREE_SITTER_ZSH_POSIX
+#define ZSH_EXTENSIONS 0
+#define LANGUAGE_FUNCTION(name) tree_sitter_zsh_posix_##name
+#else
+#define ZSH_EXTENSIONS 1
+#define LANGUAGE_FUNCTION(name) tree_sitter_zsh_##name
+#endif
+
+// Marks the functions exported by the library, so that they stay visible when
+// it is built with -fvisibility=hidden, as parser.c does for the language
+#if defined(TREE_SITTER_HIDE_SYMBOLS) || defined(_WIN32)
+#define SCANNER_PUBLIC
+#else
+#define SCANNER_PUBLIC __attribute__((visibility("default")))
+#endif
+
 enum TokenType {
     HEREDOC_START,
     SIMPLE_HEREDOC_BODY,
@@ -158,7 +178,10 @@ typedef struct {
     bool started;
     bool allows_indent;
     String delimiter;
-    String current_leading_word;
+    // Cached when the delimiter is set, to reject most lines on their first
+    // character: the first byte and the length up to the trailing '\0'
+    int32_t delimiter_first;
+    uint32_t delimiter_length;
 } Heredoc;
 
 #define heredoc_new()                                                          \
@@ -167,47 +190,258 @@ typedef struct {
         .started = false,                                                      \
         .allows_indent = false,                                                \
         .delimiter = array_new(),                                              \
-        .current_leading_word = array_new(),                                   \
+        .delimiter_first = '\0',                                               \
+        .delimiter_length = 0,                                                 \
     };
 
+#ifdef TREE_SITTER_ZSH_HEREDOC_ARENA
+
+// With TREE_SITTER_ZSH_HEREDOC_ARENA, heredoc delimiters live in a bump
+// allocator owned by the scanner instead of in their own growable arrays.
+// Delimiters are never modified once stored, so heredocs that share a
+// delimiter can share its bytes, and the whole arena is released at once
+// whenever the heredocs are rebuilt by reset() or deserialize(). Chunks never
+// move, so stored delimiters stay valid as the arena grows.
+#define ARENA_CHUNK_SIZE 1024
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    uint32_t size;
+    uint32_t capacity;
+    char contents[];
+} ArenaChunk;
+
+typedef struct {
+    ArenaChunk *head; // the newest and largest chunk, older ones follow
+} StringArena;
+
+static char *arena_copy(StringArena *arena, const char *contents,
+                        uint32_t size) {
+    ArenaChunk *chunk = arena->head;
+    if (!chunk || chunk->capacity - chunk->size < size) {
+        uint32_t capacity = chunk ? chunk->capacity * 2 : ARENA_CHUNK_SIZE;
+        if (capacity < size) {
+            capacity = size;
+        }
+        chunk = ts_malloc(sizeof(ArenaChunk) + capacity);
+        chunk->next = arena->head;
+        chunk->size = 0;
+        chunk->capacity = capacity;
+        arena->head = chunk;
+    }
+    char *copy = &chunk->contents[chunk->size];
+    memcpy(copy, contents, size);
+    chunk->size += size;
+    return copy;
+}
+
+// Keep only the newest chunk, which is large enough for what came before
+static void arena_reset(StringArena *arena) {
+    ArenaChunk *chunk = arena->head;
+    if (!chunk) {
+        return;
+    }
+    while (chunk->next) {
+        ArenaChunk *next = chunk->next->next;
+        ts_free(chunk->next);
+        chunk->next = next;
+    }
+    chunk->size = 0;
+}
+
+static void arena_delete(StringArena *arena) {
+    while (arena->head) {
+        ArenaChunk *next = arena->head->next;
+        ts_free(arena->head);
+        arena->head = next;
+    }
+}
+
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SCANNER_THREAD_LOCAL __declspec(thread)
+#else
+#define SCANNER_THREAD_LOCAL _Thread_local
+#endif
+
+#if defined(TREE_SITTER_ZSH_SCANNER_STATS) ||                                  \
+    defined(TREE_SITTER_ZSH_SCANNER_TRACE)
+#define SCANNER_COUNT_CHARACTERS
+// Characters advanced over or skipped by scans on this thread
+static SCANNER_THREAD_LOCAL uint64_t scan_characters;
+#endif
+
+#ifdef TREE_SITTER_ZSH_SCANNER_STATS
+// The deepest context stack on this thread since the last stats reset
+static SCANNER_THREAD_LOCAL uint32_t stats_max_context_depth;
+#endif
+
+// Frames kept inside the scanner before the context stack spills to the heap
+#define CONTEXT_STACK_INLINE_CAPACITY 16
+
+typedef struct {
+    uint8_t *heap;     // NULL until the stack outgrows the inline frames
+    uint32_t size;
+    uint32_t capacity; // of the heap frames
+    uint8_t top;       // the innermost context, CTX_NONE when empty
+    uint8_t inline_frames[CONTEXT_STACK_INLINE_CAPACITY];
+} ContextStack;
+
+static inline uint8_t *context_frames(ContextStack *stack) {
+    return stack->heap ? stack->heap : stack->inline_frames;
+}
+
+static void context_stack_reserve(ContextStack *stack, uint32_t capacity) {
+    uint32_t current =
+        stack->heap ? stack->capacity : CONTEXT_STACK_INLINE_CAPACITY;
+    if (capacity <= current) {
+        return;
+    }
+    uint32_t new_capacity = current * 2 > capacity ? current * 2 : capacity;
+    uint8_t *heap = ts_realloc(stack->heap, new_capacity);
+    if (!stack->heap) {
+        memcpy(heap, stack->inline_frames, stack->size);
+    }
+    stack->heap = heap;
+    stack->capacity = new_capacity;
+}
+
+static inline void context_stack_push(ContextStack *stack,
+                                      context_type_t context) {
+    if (stack->size == CONTEXT_STACK_INLINE_CAPACITY || stack->heap) {
+        context_stack_reserve(stack, stack->size + 1);
+    }
+    context_frames(stack)[stack->size++] = (uint8_t)context;
+    stack->top = (uint8_t)context;
+#ifdef TREE_SITTER_ZSH_SCANNER_STATS
+    if (stack->size > stats_max_context_depth) {
+        stats_max_context_depth = stack->size;
+    }
+#endif
+}
+
+static inline void context_stack_pop(ContextStack *stack) {
+    stack->size--;
+    stack->top = stack->size > 0 ? context_frames(stack)[stack->size - 1]
+                                 : (uint8_t)CTX_NONE;
+}
+
+static inline void context_stack_clear(ContextStack *stack) {
+    stack->size = 0;
+    stack->top = CTX_NONE;
+}
+
+static inline void context_stack_delete(ContextStack *stack) {
+    ts_free(stack->heap);
+    stack->heap = NULL;
+    stack->size = 0;
+    stack->capacity = 0;
+    stack->top = CTX_NONE;
+}
+
+#ifdef TREE_SITTER_ZSH_SCANNER_TRACE
+
+// Events kept per scanner, a power of two
+#ifndef SCANNER_TRACE_SIZE
+#define SCANNER_TRACE_SIZE 256
+#endif
+
+// TraceEvent.symbol of an event for a handler being tried, and of the end of
+// a scan that produced no token
+#define TRACE_TRY 0xff
+#define TRACE_REJECT 0xfe
+
+// One step of a scan: a handler being tried, or the scan returning with the
+// token it produced. Nothing is formatted while tracing, the events are
+// exported by tree_sitter_zsh_scanner_trace and decoded by
+// script/decode-scanner-trace.
+typedef struct {
+    uint8_t handler; // HANDLER_COUNT when the scan tried no handler
+    uint8_t symbol;  // TokenType, TRACE_TRY or TRACE_REJECT
+    uint8_t context; // top of the context stack
+    uint8_t depth;   // context stack size, saturated
+    uint32_t offset; // characters consumed since the scan started
+} TraceEvent;
+
+typedef struct {
+    uint32_t count; // events ever written, the next one goes to count % size
+    uint8_t handler;
+    uint64_t scan_start;
+    TraceEvent events[SCANNER_TRACE_SIZE];
+} TraceRing;
+
+#endif
+
 typedef struct {
     uint8_t last_glob_paren_depth;
     bool ext_was_in_double_quote;
     bool ext_saw_outside_quote;
-    Array(context_type_t) context_stack; // Proper context stack
     bool just_returned_variable_name; // Track if we just returned VARIABLE_NAME
     bool just_returned_bare_dollar;   // Track if we just returned BARE_DOLLAR
     bool just_exited_string; // Track if we just exited a string context
     bool just_newline;       // Track if we just handled newline
+    ContextStack context_stack;
     Array(Heredoc) heredocs;
+#ifdef TREE_SITTER_ZSH_HEREDOC_ARENA
+    StringArena arena; // Storage for every heredoc delimiter
+    String word;       // Scratch buffer for the delimiter being scanned
+#endif
+#ifdef TREE_SITTER_ZSH_SCANNER_TRACE
+    TraceRing trace;
+#endif
 } Scanner;
 
-static inline void advance(TSLexer *lexer) { lexer->advance(lexer, false); }
+static inline void advance(TSLexer *lexer) {
+#ifdef SCANNER_COUNT_CHARACTERS
+    scan_characters++;
+#endif
+    lexer->advance(lexer, false);
+}
 
 // Context management functions using proper stack
 static inline context_type_t get_current_context(Scanner *scanner) {
-    if (scanner->context_stack.size == 0) {
-        return CTX_NONE;
-    }
-    return *array_back(&scanner->context_stack);
+    return (context_type_t)scanner->context_stack.top;
+}
+
+// Classes of contexts, so that each context predicate is a single mask test
+enum {
+    CONTEXT_PARAMETER = 1 << 0,     // ${...}, including its patterns
+    CONTEXT_PATTERN = 1 << 1,       // ${var%pattern} and ${var/pattern/...}
+    CONTEXT_PATTERN_SLASH = 1 << 2, // ${var/pattern/replacement}
+    CONTEXT_EXPANSION = 1 << 3,     // ${...}, $((...)) and $(...)
+    CONTEXT_TEST = 1 << 4,          // [[ ... ]]
+};
+
+static const uint8_t ContextClasses[CTX_RAW_STRING + 1] = {
+    [CTX_PARAMETER] = CONTEXT_PARAMETER | CONTEXT_EXPANSION,
+    [CTX_ARITHMETIC] = CONTEXT_EXPANSION,
+    [CTX_COMMAND] = CONTEXT_EXPANSION,
+    [CTX_TEST] = CONTEXT_TEST,
+    [CTX_PARAMETER_PATTERN_SUFFIX] = CONTEXT_PARAMETER | CONTEXT_PATTERN,
+    [CTX_PARAMETER_PATTERN_SUBSTITUTE] =
+        CONTEXT_PARAMETER | CONTEXT_PATTERN | CONTEXT_PATTERN_SLASH,
+};
+
+static inline bool context_is(context_type_t ctx, uint8_t classes) {
+    return ContextClasses[ctx] & classes;
+}
+
+static inline bool in_context(Scanner *scanner, uint8_t classes) {
+    return context_is(get_current_context(scanner), classes);
 }
 
 static inline bool in_parameter_expansion(Scanner *scanner) {
-    context_type_t ctx = get_current_context(scanner);
-    return ctx == CTX_PARAMETER || ctx == CTX_PARAMETER_PATTERN_SUFFIX ||
-           ctx == CTX_PARAMETER_PATTERN_SUBSTITUTE;
+    return in_context(scanner, CONTEXT_PARAMETER);
 }
 
 // Helper to determine if we should stop at pattern operators
 static inline bool should_stop_at_pattern_operators(Scanner *scanner) {
-    context_type_t ctx = get_current_context(scanner);
-    return ctx == CTX_PARAMETER || ctx == CTX_PARAMETER_PATTERN_SUFFIX ||
-           ctx == CTX_PARAMETER_PATTERN_SUBSTITUTE;
+    return in_context(scanner, CONTEXT_PARAMETER);
 }
 
 static inline bool should_stop_at_pattern_slash(Scanner *scanner) {
-    context_type_t ctx = get_current_context(scanner);
-    return ctx == CTX_PARAMETER_PATTERN_SUBSTITUTE;
+    return in_context(scanner, CONTEXT_PATTERN_SLASH);
 }
 
 // Helper to check if we're in parameter expansion context (for tokenization
@@ -218,31 +452,30 @@ static inline bool in_parameter_expansion_context(Scanner *scanner) {
 
 // Helper to check if we should break on '/' in EXPANSION_WORD
 static inline bool should_break_on_slash(Scanner *scanner) {
-    context_type_t ctx = get_current_context(scanner);
-    return ctx == CTX_PARAMETER_PATTERN_SUBSTITUTE;
+    return in_context(scanner, CONTEXT_PATTERN_SLASH);
 }
 static inline void enter_context(Scanner *scanner, context_type_t context) {
 #if DEBUG
     fprintf(stderr, "DEBUG: Entering context %s\n", ContextNames[context]);
     for (int i = 0; i < scanner->context_stack.size; ++i) {
         fprintf(stderr, "   DEBUG: context_stack %d= %s\n", i,
-                ContextNames[*array_get(&scanner->context_stack, i)]);
+                ContextNames[context_frames(&scanner->context_stack)[i]]);
     }
 #endif
-    array_push(&scanner->context_stack, context);
+    context_stack_push(&scanner->context_stack, context);
 }
 
 static inline void exit_context(Scanner *scanner,
                                 context_type_t expected_context) {
     if (scanner->context_stack.size > 0) {
-        context_type_t current = *array_back(&scanner->context_stack);
+        context_type_t current = get_current_context(scanner);
         // Verify we're exiting the expected context (for debugging)
         if (current == expected_context) {
 #if DEBUG
             fprintf(stderr, "DEBUG: Exiting matching context %s\n",
                     ContextNames[current]);
 #endif
-            array_pop(&scanner->context_stack);
+            context_stack_pop(&scanner->context_stack);
         } else {
 #if DEBUG
             fprintf(stderr,
@@ -250,12 +483,12 @@ static inline void exit_context(Scanner *scanner,
                     ContextNames[current], ContextNames[expected_context]);
 #endif
             // Gracefully handle mismatched contexts by popping anyway
-            array_pop(&scanner->context_stack);
+            context_stack_pop(&scanner->context_stack);
         }
 #if DEBUG
         for (int i = 0; i < scanner->context_stack.size; ++i) {
             fprintf(stderr, "   DEBUG: context_stack %d= %s\n", i,
-                    ContextNames[*array_get(&scanner->context_stack, i)]);
+                    ContextNames[context_frames(&scanner->context_stack)[i]]);
         }
 #endif
     }
@@ -263,25 +496,79 @@ static inline void exit_context(Scanner *scanner,
 
 // Helper functions for checking contexts
 static inline bool in_expansion_context(Scanner *scanner) {
-    context_type_t ctx = get_current_context(scanner);
-    return ctx == CTX_PARAMETER || ctx == CTX_ARITHMETIC || ctx == CTX_COMMAND;
+    return in_context(scanner, CONTEXT_EXPANSION);
 }
 
 static inline bool in_pattern_context(Scanner *scanner) {
-    context_type_t ctx = get_current_context(scanner);
-    return ctx == CTX_PARAMETER_PATTERN_SUFFIX ||
-           ctx == CTX_PARAMETER_PATTERN_SUBSTITUTE;
+    return in_context(scanner, CONTEXT_PATTERN);
 }
 
 static inline bool in_test_command(Scanner *scanner) {
-    context_type_t ctx = get_current_context(scanner);
-    return ctx == CTX_TEST;
+    return in_context(scanner, CONTEXT_TEST);
+}
+
+#define IS_LOWER(c) ((c) >= 'a' && (c) <= 'z')
+#define IS_UPPER(c) ((c) >= 'A' && (c) <= 'Z')
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+// Character classes of ASCII, which is nearly all of the input, so that the
+// scanning loops do not call the locale-aware wide character functions on
+// every character. They agree with those functions for ASCII in the C and
+// UTF-8 locales, which still classify every other code point.
+enum {
+    CHAR_SPACE = 1 << 0,
+    CHAR_ALPHA = 1 << 1,
+    CHAR_DIGIT = 1 << 2,
+};
+
+#define CHAR_CLASS(c)                                                          \
+    ((((c) >= '\t' && (c) <= '\r') || (c) == ' ') * CHAR_SPACE |               \
+     (IS_LOWER(c) || IS_UPPER(c)) * CHAR_ALPHA | IS_DIGIT(c) * CHAR_DIGIT)
+
+#define CC2(c) CHAR_CLASS(c), CHAR_CLASS((c) + 1)
+#define CC8(c) CC2(c), CC2((c) + 2), CC2((c) + 4), CC2((c) + 6)
+#define CC32(c) CC8(c), CC8((c) + 8), CC8((c) + 16), CC8((c) + 24)
+
+static const uint8_t CharClasses[128] = {
+    CC32(0),
+    CC32(32),
+    CC32(64),
+    CC32(96),
+};
+
+#undef CC2
+#undef CC8
+#undef CC32
+
+static inline bool is_space(int32_t c) {
+    return c >= 0 && c < 128 ? CharClasses[c] & CHAR_SPACE : iswspace(c);
+}
+
+static inline bool is_alpha(int32_t c) {
+    return c >= 0 && c < 128 ? CharClasses[c] & CHAR_ALPHA : iswalpha(c);
 }
 
-static inline void skip(TSLexer *lexer) { lexer->advance(lexer, true); }
+static inline bool is_digit(int32_t c) {
+    return c >= 0 && c < 128 ? CharClasses[c] & CHAR_DIGIT : iswdigit(c);
+}
+
+static inline bool is_alnum(int32_t c) {
+    return c >= 0 && c < 128 ? CharClasses[c] & (CHAR_ALPHA | CHAR_DIGIT)
+                             : iswalnum(c);
+}
+
+// Whether `c` can be one of the flags of a (#flags) group
+static inline bool is_glob_flag(int32_t c) { return is_alnum(c) || c == '.'; }
+
+static inline void skip(TSLexer *lexer) {
+#ifdef SCANNER_COUNT_CHARACTERS
+    scan_characters++;
+#endif
+    lexer->advance(lexer, true);
+}
 
 static inline void skip_ws(TSLexer *lexer) {
-    while (iswspace(lexer->lookahead) && lexer->lookahead != '\n' &&
+    while (is_space(lexer->lookahead) && lexer->lookahead != '\n' &&
            !lexer->eof(lexer)) {
 #if DEBUG
         fprintf(stderr, "WARNING skip_ws skipping space");
@@ -290,7 +577,7 @@ static inline void skip_ws(TSLexer *lexer) {
     }
 }
 static inline void skip_wsnl(TSLexer *lexer) {
-    while (iswspace(lexer->lookahead) && !lexer->eof(lexer)) {
+    while (is_space(lexer->lookahead) && !lexer->eof(lexer)) {
 #if DEBUG
         fprintf(stderr, "WARNING skip_wsnl skipping space");
 #endif
@@ -302,11 +589,17 @@ static inline bool in_error_recovery(const bool *valid_symbols) {
     return valid_symbols[ERROR_RECOVERY];
 }
 
-static inline void reset_string(String *string) {
-    if (string->size > 0) {
-        memset(string->contents, 0, string->size);
-        array_clear(string);
+static inline void reset_string(String *string) { array_clear(string); }
+
+static inline void cache_delimiter(Heredoc *heredoc) {
+    const String *delimiter = &heredoc->delimiter;
+    uint32_t length = 0;
+    while (length < delimiter->size && delimiter->contents[length] != '\0') {
+        length++;
     }
+    heredoc->delimiter_first =
+        delimiter->size > 0 ? (int32_t)delimiter->contents[0] : '\0';
+    heredoc->delimiter_length = length;
 }
 
 static inline void reset_heredoc(Heredoc *heredoc) {
@@ -314,6 +607,56 @@ static inline void reset_heredoc(Heredoc *heredoc) {
     heredoc->started = false;
     heredoc->allows_indent = false;
     reset_string(&heredoc->delimiter);
+    cache_delimiter(heredoc);
+}
+
+static inline void delete_heredoc(Heredoc *heredoc) {
+#ifdef TREE_SITTER_ZSH_HEREDOC_ARENA
+    // The delimiter belongs to the arena
+    heredoc->delimiter = (String)array_new();
+#else
+    array_delete(&heredoc->delimiter);
+#endif
+}
+
+static inline void set_delimiter(Scanner *scanner, Heredoc *heredoc,
+                                 const char *contents, uint32_t size) {
+#ifdef TREE_SITTER_ZSH_HEREDOC_ARENA
+    heredoc->delimiter.contents =
+        size > 0 ? arena_copy(&scanner->arena, contents, size) : NULL;
+    heredoc->delimiter.size = size;
+    heredoc->delimiter.capacity = 0;
+#else
+    (void)scanner;
+    array_clear(&heredoc->delimiter);
+    if (size > 0) {
+        array_extend(&heredoc->delimiter, size, contents);
+    }
+#endif
+    cache_delimiter(heredoc);
+}
+
+// Give `heredoc` the same delimiter as `other`
+static inline void share_delimiter(Scanner *scanner, Heredoc *heredoc,
+                                   const Heredoc *other) {
+#ifdef TREE_SITTER_ZSH_HEREDOC_ARENA
+    (void)scanner;
+    heredoc->delimiter = other->delimiter;
+    cache_delimiter(heredoc);
+#else
+    set_delimiter(scanner, heredoc, other->delimiter.contents,
+                  other->delimiter.size);
+#endif
+}
+
+// Drop every heredoc past the first `count`
+static inline void truncate_heredocs(Scanner *scanner, uint32_t count) {
+    for (uint32_t i = count; i < scanner->heredocs.size; i++) {
+        delete_heredoc(array_get(&scanner->heredocs, i));
+    }
+    if (count < scanner->heredocs.size) {
+        scanner->heredocs.size = count;
+    }
 }
 
 static inline void reset(Scanner *scanner) {
@@ -324,55 +667,249 @@ static inline void reset(Scanner *scanner) {
     scanner->last_glob_paren_depth = 0;
     scanner->ext_was_in_double_quote = false;
     scanner->ext_saw_outside_quote = false;
-    scanner->context_stack.size = 0; // Clear context stack
+    context_stack_clear(&scanner->context_stack);
     scanner->just_returned_variable_name = false;
     scanner->just_returned_bare_dollar = false;
     scanner->just_exited_string = false;
     scanner->just_newline = false;
-    for (uint32_t i = 0; i < scanner->heredocs.size; i++) {
-        reset_heredoc(array_get(&scanner->heredocs, i));
-    }
+    truncate_heredocs(scanner, 0);
+#ifdef TREE_SITTER_ZSH_HEREDOC_ARENA
+    arena_reset(&scanner->arena);
+#endif
 #if DEBUG
     fprintf(stderr, "DEBUG: Reset done - heredocs.size after=%u %u\n",
             scanner->heredocs.size, scanner->context_stack.size);
 #endif
 }
 
+/**
+ * Serialized scanner state.
+ *
+ * The empty state (no contexts, no heredocs, every flag clear) serializes to
+ * nothing at all. When only the flags are set the state is the single flags
+ * byte. Anything else is the flags byte, the format version and then:
+ *
+ *   glob paren depth   1 byte
+ *   context count      varint, followed by the contexts as a stream of 4-bit
+ *                      ids, two per byte, low nibble first. CONTEXT_REPEAT
+ *                      followed by two nibbles n repeats the previous context
+ *                      n + 1 more times, so deep ${${${...}}} nesting stays
+ *                      small.
+ *   heredoc count      varint, followed by each heredoc as a flags byte and
+ *                      either the delimiter length as a varint and the
+ *                      delimiter bytes, or with HEREDOC_SHARED_DELIMITER set,
+ *                      the varint index of an earlier heredoc with the same
+ *                      delimiter.
+ *
+ * serialize() only gives up and returns 0 when even this encoding does not
+ * fit in TREE_SITTER_SERIALIZATION_BUFFER_SIZE.
+ */
+#define SERIALIZATION_VERSION 2
+
+#define MAX_VARINT_SIZE 5
+
+enum {
+    STATE_EXT_WAS_IN_DOUBLE_QUOTE = 1 << 0,
+    STATE_EXT_SAW_OUTSIDE_QUOTE = 1 << 1,
+    STATE_JUST_RETURNED_VARIABLE_NAME = 1 << 2,
+    STATE_JUST_RETURNED_BARE_DOLLAR = 1 << 3,
+    STATE_JUST_EXITED_STRING = 1 << 4,
+    STATE_JUST_NEWLINE = 1 << 5,
+};
+
+enum {
+    HEREDOC_IS_RAW = 1 << 0,
+    HEREDOC_STARTED = 1 << 1,
+    HEREDOC_ALLOWS_INDENT = 1 << 2,
+    HEREDOC_SHARED_DELIMITER = 1 << 3,
+};
+
+#define CONTEXT_REPEAT 0x0f
+#define MAX_CONTEXT_REPEAT 256
+
+// Delimiters shorter than this are cheaper to store than to refer back to
+#define MIN_SHARED_DELIMITER_SIZE 3
+
+// Slots in the open-addressed table used to find repeated delimiters
+#define DELIMITER_TABLE_SIZE 64
+
+static inline unsigned write_varint(char *buffer, uint32_t value) {
+    unsigned size = 0;
+    while (value >= 0x80) {
+        buffer[size++] = (char)(value | 0x80);
+        value >>= 7;
+    }
+    buffer[size++] = (char)value;
+    return size;
+}
+
+static inline uint32_t read_varint(const char *buffer, unsigned length,
+                                   uint32_t *size) {
+    uint32_t value = 0;
+    for (uint32_t shift = 0; *size < length && shift < 32; shift += 7) {
+        unsigned char byte = (unsigned char)buffer[(*size)++];
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    return value;
+}
+
+static inline void write_nibble(char *buffer, uint32_t *nibble,
+                                unsigned value) {
+    char *byte = &buffer[*nibble / 2];
+    if (*nibble % 2 == 0) {
+        *byte = (char)value;
+    } else {
+        *byte = (char)((unsigned char)*byte | (value << 4));
+    }
+    (*nibble)++;
+}
+
+static inline unsigned read_nibble(const char *buffer, uint32_t nibble) {
+    unsigned char byte = (unsigned char)buffer[nibble / 2];
+    return nibble % 2 ? byte >> 4 : byte & 0x0f;
+}
+
+// FNV-1a
+static inline uint32_t hash_delimiter(const String *delimiter) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < delimiter->size; i++) {
+        hash = (hash ^ (unsigned char)delimiter->contents[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static inline bool delimiters_equal(const String *a, const String *b) {
+    return a->size == b->size && memcmp(a->contents, b->contents, a->size) == 0;
+}
+
+// Return the index of an earlier heredoc with the same delimiter, or record
+// this one and return `index` itself when there is none
+static uint32_t intern_delimiter(Scanner *scanner, uint32_t *table,
+                                 uint32_t index) {
+    const String *delimiter = &array_get(&scanner->heredocs, index)->delimiter;
+    uint32_t slot = hash_delimiter(delimiter) % DELIMITER_TABLE_SIZE;
+    for (uint32_t probe = 0; probe < DELIMITER_TABLE_SIZE; probe++) {
+        if (table[slot] == 0) {
+            table[slot] = index + 1;
+            return index;
+        }
+        const String *other =
+            &array_get(&scanner->heredocs, table[slot] - 1)->delimiter;
+        if (delimiters_equal(delimiter, other)) {
+            return table[slot] - 1;
+        }
+        slot = (slot + 1) % DELIMITER_TABLE_SIZE;
+    }
+    return index;
+}
+
+// The number of frames at the start of `frames` equal to the first, taking
+// eight at a time. Deep nesting is mostly long runs, and every token
+// serializes the whole stack.
+static inline uint32_t context_run(const uint8_t *frames, uint32_t count) {
+    const uint64_t repeated = frames[0] * UINT64_C(0x0101010101010101);
+    uint32_t run = 1;
+    while (run + 8 <= count) {
+        uint64_t word;
+        memcpy(&word, &frames[run], sizeof(word));
+        if (word != repeated) {
+            break;
+        }
+        run += 8;
+    }
+    while (run < count && frames[run] == frames[0]) {
+        run++;
+    }
+    return run;
+}
+
 static unsigned serialize(Scanner *scanner, char *buffer) {
-    uint32_t size = 0;
+    unsigned char flags =
+        (scanner->ext_was_in_double_quote ? STATE_EXT_WAS_IN_DOUBLE_QUOTE
+                                          : 0) |
+        (scanner->ext_saw_outside_quote ? STATE_EXT_SAW_OUTSIDE_QUOTE : 0) |
+        (scanner->just_returned_variable_name
+             ? STATE_JUST_RETURNED_VARIABLE_NAME
+             : 0) |
+        (scanner->just_returned_bare_dollar ? STATE_JUST_RETURNED_BARE_DOLLAR
+                                            : 0) |
+        (scanner->just_exited_string ? STATE_JUST_EXITED_STRING : 0) |
+        (scanner->just_newline ? STATE_JUST_NEWLINE : 0);
+
+    if (scanner->context_stack.size == 0 && scanner->heredocs.size == 0 &&
+        scanner->last_glob_paren_depth == 0) {
+        if (flags == 0) {
+            return 0;
+        }
+        buffer[0] = (char)flags;
+        return 1;
+    }
 
+    uint32_t size = 0;
+    buffer[size++] = (char)flags;
+    buffer[size++] = SERIALIZATION_VERSION;
     buffer[size++] = (char)scanner->last_glob_paren_depth;
-    buffer[size++] = (char)scanner->ext_was_in_double_quote;
-    buffer[size++] = (char)scanner->ext_saw_outside_quote;
-    buffer[size++] = (char)scanner->context_stack.size;
-    buffer[size++] = (char)scanner->heredocs.size;
-    buffer[size++] = (char)scanner->just_returned_variable_name;
-    buffer[size++] = (char)scanner->just_returned_bare_dollar;
-    buffer[size++] = (char)scanner->just_exited_string;
-    buffer[size++] = (char)scanner->just_newline;
-
-    // Serialize context stack
-    for (uint32_t i = 0; i < scanner->context_stack.size; i++) {
-        if (size >= TREE_SITTER_SERIALIZATION_BUFFER_SIZE) {
-            return 0;
+
+    // Serialize context stack, leaving room for the heredoc count
+    uint32_t context_count = scanner->context_stack.size;
+    const uint8_t *contexts = context_frames(&scanner->context_stack);
+    size += write_varint(&buffer[size], context_count);
+    uint32_t nibble = 0;
+    for (uint32_t i = 0; i < context_count;) {
+        uint8_t ctx = contexts[i];
+        uint32_t run = context_run(&contexts[i], context_count - i);
+        i += run;
+        for (bool first = true; run > 0; first = false) {
+            if (size + (nibble + 4) / 2 + MAX_VARINT_SIZE >=
+                TREE_SITTER_SERIALIZATION_BUFFER_SIZE) {
+                return 0;
+            }
+            if (!first && run > 3) {
+                uint32_t repeat =
+                    run < MAX_CONTEXT_REPEAT ? run : MAX_CONTEXT_REPEAT;
+                write_nibble(&buffer[size], &nibble, CONTEXT_REPEAT);
+                write_nibble(&buffer[size], &nibble, (repeat - 1) & 0x0f);
+                write_nibble(&buffer[size], &nibble, (repeat - 1) >> 4);
+                run -= repeat;
+            } else {
+                write_nibble(&buffer[size], &nibble, ctx & 0x0f);
+                run--;
+            }
         }
-        context_type_t *ctx = array_get(&scanner->context_stack, i);
-        buffer[size++] = (char)*ctx;
     }
+    size += (nibble + 1) / 2;
 
+    size += write_varint(&buffer[size], scanner->heredocs.size);
+    uint32_t delimiter_table[DELIMITER_TABLE_SIZE] = {0};
     for (uint32_t i = 0; i < scanner->heredocs.size; i++) {
         Heredoc *heredoc = array_get(&scanner->heredocs, i);
-        if (size + 3 + sizeof(uint32_t) + heredoc->delimiter.size >=
+        unsigned char heredoc_flags =
+            (heredoc->is_raw ? HEREDOC_IS_RAW : 0) |
+            (heredoc->started ? HEREDOC_STARTED : 0) |
+            (heredoc->allows_indent ? HEREDOC_ALLOWS_INDENT : 0);
+        uint32_t shared = heredoc->delimiter.size >= MIN_SHARED_DELIMITER_SIZE
+                              ? intern_delimiter(scanner, delimiter_table, i)
+                              : i;
+        if (shared != i) {
+            if (size + 1 + MAX_VARINT_SIZE >=
+                TREE_SITTER_SERIALIZATION_BUFFER_SIZE) {
+                return 0;
+            }
+            buffer[size++] = (char)(heredoc_flags | HEREDOC_SHARED_DELIMITER);
+            size += write_varint(&buffer[size], shared);
+            continue;
+        }
+
+        if (size + 1 + MAX_VARINT_SIZE + heredoc->delimiter.size >=
             TREE_SITTER_SERIALIZATION_BUFFER_SIZE) {
             return 0;
         }
 
-        buffer[size++] = (char)heredoc->is_raw;
-        buffer[size++] = (char)heredoc->started;
-        buffer[size++] = (char)heredoc->allows_indent;
-
-        memcpy(&buffer[size], &heredoc->delimiter.size, sizeof(uint32_t));
-        size += sizeof(uint32_t);
+        buffer[size++] = (char)heredoc_flags;
+        size += write_varint(&buffer[size], heredoc->delimiter.size);
         if (heredoc->delimiter.size > 0) {
             memcpy(&buffer[size], heredoc->delimiter.contents,
                    heredoc->delimiter.size);
@@ -389,75 +926,131 @@ static void deserialize(Scanner *scanner, const char *buffer, unsigned length) {
             "ctx_stack=%u\n",
             length, scanner->heredocs.size, scanner->context_stack.size);
 #endif
-    if (length == 0) {
+    if (length == 0 ||
+        (length > 1 && buffer[1] != SERIALIZATION_VERSION)) {
         reset(scanner);
-    } else {
-        uint32_t size = 0;
-        scanner->last_glob_paren_depth = buffer[size++];
-        scanner->ext_was_in_double_quote = buffer[size++];
-        scanner->ext_saw_outside_quote = buffer[size++];
-        uint32_t context_stack_size = (unsigned char)buffer[size++];
-        uint32_t heredoc_count = (unsigned char)buffer[size++];
-#if DEBUG
-        fprintf(stderr,
-                "DEBUG: Deserialize - heredoc_count=%u context_stack_size=%u\n",
-                heredoc_count, context_stack_size);
-#endif
-        scanner->just_returned_variable_name = buffer[size++];
-        scanner->just_returned_bare_dollar = buffer[size++];
-        scanner->just_exited_string = buffer[size++];
-        scanner->just_newline = buffer[size++];
-
-        // Deserialize context stack
-        scanner->context_stack.size = 0;
-        for (uint32_t i = 0; i < context_stack_size; i++) {
-            if (size >= length)
-                break;
-            context_type_t ctx = (context_type_t)buffer[size++];
-            array_push(&scanner->context_stack, ctx);
-        }
+        return;
+    }
 
-        for (uint32_t i = 0; i < heredoc_count; i++) {
-            Heredoc *heredoc = NULL;
-            if (i < scanner->heredocs.size) {
-                heredoc = array_get(&scanner->heredocs, i);
-            } else {
-                Heredoc new_heredoc = heredoc_new();
-                array_push(&scanner->heredocs, new_heredoc);
-                heredoc = array_back(&scanner->heredocs);
+    unsigned char flags = (unsigned char)buffer[0];
+    scanner->ext_was_in_double_quote = flags & STATE_EXT_WAS_IN_DOUBLE_QUOTE;
+    scanner->ext_saw_outside_quote = flags & STATE_EXT_SAW_OUTSIDE_QUOTE;
+    scanner->just_returned_variable_name =
+        flags & STATE_JUST_RETURNED_VARIABLE_NAME;
+    scanner->just_returned_bare_dollar =
+        flags & STATE_JUST_RETURNED_BARE_DOLLAR;
+    scanner->just_exited_string = flags & STATE_JUST_EXITED_STRING;
+    scanner->just_newline = flags & STATE_JUST_NEWLINE;
+    if (length == 1) {
+        scanner->last_glob_paren_depth = 0;
+        context_stack_clear(&scanner->context_stack);
+        truncate_heredocs(scanner, 0);
+#ifdef TREE_SITTER_ZSH_HEREDOC_ARENA
+        arena_reset(&scanner->arena);
+#endif
+        return;
+    }
+
+    uint32_t size = 2;
+    scanner->last_glob_paren_depth = (uint8_t)buffer[size++];
+
+    // Deserialize context stack
+    uint32_t context_count = read_varint(buffer, length, &size);
+    uint32_t nibble_count = (length - size) * 2;
+    if (context_count > nibble_count * MAX_CONTEXT_REPEAT) {
+        context_count = nibble_count * MAX_CONTEXT_REPEAT;
+    }
+    context_stack_reserve(&scanner->context_stack, context_count);
+    uint8_t *contexts = context_frames(&scanner->context_stack);
+    uint32_t nibble = 0;
+    uint32_t count = 0;
+    while (count < context_count && nibble < nibble_count) {
+        unsigned value = read_nibble(&buffer[size], nibble++);
+        if (value == CONTEXT_REPEAT && count > 0 &&
+            nibble + 2 <= nibble_count) {
+            uint32_t repeat = (read_nibble(&buffer[size], nibble) |
+                               read_nibble(&buffer[size], nibble + 1) << 4) +
+                              1;
+            nibble += 2;
+            // Every scan starts here, so with deep nesting filling the runs
+            // one frame at a time is most of the work of a scan
+            if (repeat > context_count - count) {
+                repeat = context_count - count;
             }
+            memset(&contexts[count], contexts[count - 1], repeat);
+            count += repeat;
+        } else {
+            contexts[count++] = (uint8_t)value;
+        }
+    }
+    scanner->context_stack.size = count;
+    scanner->context_stack.top =
+        count > 0 ? contexts[count - 1] : (uint8_t)CTX_NONE;
+    size += (nibble + 1) / 2;
 
-            heredoc->is_raw = buffer[size++];
-            heredoc->started = buffer[size++];
-            heredoc->allows_indent = buffer[size++];
+    uint32_t heredoc_count = read_varint(buffer, length, &size);
+#if DEBUG
+    fprintf(stderr,
+            "DEBUG: Deserialize - heredoc_count=%u context_stack_size=%u\n",
+            heredoc_count, scanner->context_stack.size);
+#endif
+#ifdef TREE_SITTER_ZSH_HEREDOC_ARENA
+    // Every delimiter is stored again below
+    arena_reset(&scanner->arena);
+#endif
+    for (uint32_t i = 0; i < heredoc_count; i++) {
+        Heredoc *heredoc = NULL;
+        if (i < scanner->heredocs.size) {
+            heredoc = array_get(&scanner->heredocs, i);
+        } else {
+            Heredoc new_heredoc = heredoc_new();
+            array_push(&scanner->heredocs, new_heredoc);
+            heredoc = array_back(&scanner->heredocs);
+        }
 
-            memcpy(&heredoc->delimiter.size, &buffer[size], sizeof(uint32_t));
-            size += sizeof(uint32_t);
-            array_reserve(&heredoc->delimiter, heredoc->delimiter.size);
+        unsigned char heredoc_flags = (unsigned char)buffer[size++];
+        heredoc->is_raw = heredoc_flags & HEREDOC_IS_RAW;
+        heredoc->started = heredoc_flags & HEREDOC_STARTED;
+        heredoc->allows_indent = heredoc_flags & HEREDOC_ALLOWS_INDENT;
 
-            if (heredoc->delimiter.size > 0) {
-                memcpy(heredoc->delimiter.contents, &buffer[size],
-                       heredoc->delimiter.size);
-                size += heredoc->delimiter.size;
+        if (heredoc_flags & HEREDOC_SHARED_DELIMITER) {
+            uint32_t shared = read_varint(buffer, length, &size);
+            if (shared < i) {
+                share_delimiter(scanner, heredoc,
+                                array_get(&scanner->heredocs, shared));
+            } else {
+                set_delimiter(scanner, heredoc, NULL, 0);
             }
+        } else {
+            uint32_t delimiter_size = read_varint(buffer, length, &size);
+            set_delimiter(scanner, heredoc, &buffer[size], delimiter_size);
+            size += delimiter_size;
         }
-        assert(size == length);
     }
+    truncate_heredocs(scanner, heredoc_count);
+    assert(size == length);
 #if DEBUG
     fprintf(stderr, "DEBUG: Deserialize done - heredocs.size after=%u %u\n",
             scanner->heredocs.size, scanner->context_stack.size);
 #endif
 }
 
+// The longest heredoc delimiter kept. A longer one could not be serialized
+// anyway, and an unterminated quote would otherwise buffer the rest of its
+// line, however long.
+#define MAX_DELIMITER_SIZE (TREE_SITTER_SERIALIZATION_BUFFER_SIZE / 2)
+
 /**
  * Consume a "word" in POSIX parlance, and returns it unquoted.
  *
  * This is an approximate implementation that doesn't deal with any
  * POSIX-mandated substitution, and assumes the default value for
- * IFS.
+ * IFS. Words longer than MAX_DELIMITER_SIZE are consumed but not stored,
+ * and count as empty.
  */
 static bool advance_word(TSLexer *lexer, String *unquoted_word) {
     bool empty = true;
+    uint32_t length = 0;
 
     int32_t quote = 0;
     if (lexer->lookahead == '\'' || lexer->lookahead == '"') {
@@ -468,7 +1061,7 @@ static bool advance_word(TSLexer *lexer, String *unquoted_word) {
     while (lexer->lookahead &&
            !(quote ? lexer->lookahead == quote || lexer->lookahead == '\r' ||
                          lexer->lookahead == '\n'
-                   : iswspace(lexer->lookahead))) {
+                   : is_space(lexer->lookahead))) {
         if (lexer->lookahead == '\\') {
             advance(lexer);
             if (!lexer->lookahead) {
@@ -476,10 +1069,15 @@ static bool advance_word(TSLexer *lexer, String *unquoted_word) {
             }
         }
         empty = false;
-        array_push(unquoted_word, lexer->lookahead);
+        if (length++ < MAX_DELIMITER_SIZE) {
+            array_push(unquoted_word, lexer->lookahead);
+        }
         advance(lexer);
     }
     array_push(unquoted_word, '\0');
+    if (length > MAX_DELIMITER_SIZE) {
+        empty = true;
+    }
 
     if (quote && lexer->lookahead == quote) {
         advance(lexer);
@@ -495,15 +1093,16 @@ static inline bool scan_raw_dollar(TSLexer *lexer, const bool *valid_symbols) {
         advance(lexer);
         lexer->result_symbol = BARE_DOLLAR;
         lexer->mark_end(lexer);
-        return iswspace(lexer->lookahead) || lexer->eof(lexer) ||
+        return is_space(lexer->lookahead) || lexer->eof(lexer) ||
                lexer->lookahead == '\"';
     }
 
     return false;
 }
 
-static bool scan_heredoc_start(Heredoc *heredoc, TSLexer *lexer) {
-    while (iswspace(lexer->lookahead)) {
+static bool scan_heredoc_start(Scanner *scanner, Heredoc *heredoc,
+                               TSLexer *lexer) {
+    while (is_space(lexer->lookahead)) {
         skip(lexer);
     }
 
@@ -511,34 +1110,50 @@ static bool scan_heredoc_start(Heredoc *heredoc, TSLexer *lexer) {
     heredoc->is_raw = lexer->lookahead == '\'' || lexer->lookahead == '"' ||
                       lexer->lookahead == '\\';
 
+#ifdef TREE_SITTER_ZSH_HEREDOC_ARENA
+    // Scan into the scratch buffer, then store the result in the arena
+    String *word = &scanner->word;
+    array_clear(word);
+    if (heredoc->delimiter.size > 0) {
+        array_extend(word, heredoc->delimiter.size, heredoc->delimiter.contents);
+    }
+    bool found_delimiter = advance_word(lexer, word);
+    if (found_delimiter) {
+        set_delimiter(scanner, heredoc, word->contents, word->size);
+    } else {
+        set_delimiter(scanner, heredoc, NULL, 0);
+    }
+#else
+    (void)scanner;
     bool found_delimiter = advance_word(lexer, &heredoc->delimiter);
     if (!found_delimiter) {
         reset_string(&heredoc->delimiter);
-        return false;
     }
+    cache_delimiter(heredoc);
+#endif
     return found_delimiter;
 }
 
 static bool scan_heredoc_end_identifier(Heredoc *heredoc, TSLexer *lexer) {
-    reset_string(&heredoc->current_leading_word);
-    // Scan the first 'n' characters on this line, to see if they match the
-    // heredoc delimiter
-    int32_t size = 0;
-    if (heredoc->delimiter.size > 0) {
-        while (lexer->lookahead != '\0' && lexer->lookahead != '\n' &&
-               (int32_t)*array_get(&heredoc->delimiter, size) ==
-                   lexer->lookahead &&
-               heredoc->current_leading_word.size < heredoc->delimiter.size) {
-            array_push(&heredoc->current_leading_word, lexer->lookahead);
-            advance(lexer);
-            size++;
-        }
+    // Match the first 'n' characters on this line against the heredoc
+    // delimiter in place
+    if (heredoc->delimiter.size == 0) {
+        return false;
+    }
+    if (heredoc->delimiter_length == 0) {
+        return true;
+    }
+    if (lexer->lookahead != heredoc->delimiter_first) {
+        return false;
+    }
+    const char *delimiter = heredoc->delimiter.contents;
+    uint32_t size = 0;
+    while (size < heredoc->delimiter_length && lexer->lookahead != '\n' &&
+           (int32_t)delimiter[size] == lexer->lookahead) {
+        advance(lexer);
+        size++;
     }
-    array_push(&heredoc->current_leading_word, '\0');
-    return heredoc->delimiter.size == 0
-               ? false
-               : strcmp(heredoc->current_leading_word.contents,
-                        heredoc->delimiter.contents) == 0;
+    return size == heredoc->delimiter_length;
 }
 
 static bool scan_heredoc_content(Scanner *scanner, TSLexer *lexer,
@@ -576,7 +1191,7 @@ static bool scan_heredoc_content(Scanner *scanner, TSLexer *lexer,
                 lexer->result_symbol = middle_type;
                 heredoc->started = true;
                 advance(lexer);
-                if (iswalpha(lexer->lookahead) || lexer->lookahead == '{' ||
+                if (is_alpha(lexer->lookahead) || lexer->lookahead == '{' ||
                     lexer->lookahead == '(') {
                     return true;
                 }
@@ -600,7 +1215,7 @@ static bool scan_heredoc_content(Scanner *scanner, TSLexer *lexer,
             }
             did_advance = true;
             if (heredoc->allows_indent) {
-                while (iswspace(lexer->lookahead)) {
+                while (is_space(lexer->lookahead)) {
                     advance(lexer);
                 }
             }
@@ -608,6 +1223,7 @@ static bool scan_heredoc_content(Scanner *scanner, TSLexer *lexer,
             lexer->mark_end(lexer);
             if (scan_heredoc_end_identifier(heredoc, lexer)) {
                 if (lexer->result_symbol == HEREDOC_END) {
+                    delete_heredoc(heredoc);
                     array_pop(&scanner->heredocs);
                 }
                 return true;
@@ -619,7 +1235,7 @@ static bool scan_heredoc_content(Scanner *scanner, TSLexer *lexer,
             if (lexer->get_column(lexer) == 0) {
                 // an alternative is to check the starting column of the
                 // heredoc body and track that statefully
-                while (iswspace(lexer->lookahead)) {
+                while (is_space(lexer->lookahead)) {
                     if (did_advance) {
                         advance(lexer);
                     } else {
@@ -640,85 +1256,862 @@ static bool scan_heredoc_content(Scanner *scanner, TSLexer *lexer,
                     }
                 }
             }
+            // A partial delimiter match above can stop on the newline
+            bool at_newline = lexer->lookahead == '\n';
             did_advance = true;
             advance(lexer);
+            // The rest of the line cannot start a delimiter, so run through it
+            // without going back to the column check
+            while (!at_newline && lexer->lookahead != '\0' &&
+                   lexer->lookahead != '\n' && lexer->lookahead != '\\' &&
+                   (heredoc->is_raw || lexer->lookahead != '$')) {
+                advance(lexer);
+            }
             break;
         }
         }
     }
 }
 
-static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
-#if DEBUG
-    fprintf(stderr, "SCANNER: invoked lookahead='%c'\n", lexer->lookahead);
-    for (int i = 0; i <= ERROR_RECOVERY; i++) {
-        if (valid_symbols[i]) {
-            fprintf(stderr, "SCANNER: valid symbol: %s\n", TokenNames[i]);
-        }
-    }
+// Valid symbols packed into a single word, one bit per TokenType
+typedef uint64_t symbol_mask_t;
+
+#define SYM(symbol) ((symbol_mask_t)1 << (symbol))
+
+// Unrolls a loop with a constant trip count, so that the mask loops below
+// compile to straight-line code without a branch per iteration
+#if defined(__GNUC__) || defined(__clang__)
+#define UNROLL_LOOP _Pragma("GCC unroll 64")
+#else
+#define UNROLL_LOOP
 #endif
 
-    // Clear flag at start and capture its previous value
-    bool was_just_variable_name = scanner->just_returned_variable_name;
-    scanner->just_returned_variable_name = false;
+static inline symbol_mask_t pack_valid_symbols(const bool *valid_symbols) {
+    // Each bool is 0 or 1, so one multiply gathers 8 of them packed into a
+    // word into the top byte
+    symbol_mask_t mask = 0;
+    uint32_t i = 0;
+    UNROLL_LOOP
+    for (; i + 8 <= ERROR_RECOVERY + 1; i += 8) {
+        uint8_t bytes[8];
+        memcpy(bytes, &valid_symbols[i], 8);
+        uint64_t word = (uint64_t)bytes[0] | (uint64_t)bytes[1] << 8 |
+                        (uint64_t)bytes[2] << 16 | (uint64_t)bytes[3] << 24 |
+                        (uint64_t)bytes[4] << 32 | (uint64_t)bytes[5] << 40 |
+                        (uint64_t)bytes[6] << 48 | (uint64_t)bytes[7] << 56;
+        mask |= ((word * 0x0102040810204080ULL) >> 56) << i;
+    }
+    for (; i <= ERROR_RECOVERY; i++) {
+        mask |= (symbol_mask_t)valid_symbols[i] << i;
+    }
+    return mask;
+}
 
-    bool was_just_bare_dollar = scanner->just_returned_bare_dollar;
-    scanner->just_returned_bare_dollar = false;
+// The handlers in scan(), in the order they are tried
+typedef enum {
+    H_CONCAT,
+    H_DOUBLE_QUOTE,
+    H_SINGLE_QUOTE,
+    H_BACKTICK,
+    H_NEWLINE,
+    H_CLOSING_BRACE,
+    H_BARE_DOLLAR,
+    H_PEEK_BARE_DOLLAR,
+    H_BRACE_START,
+    H_OPENING_PAREN,
+    H_OPENING_BRACKET,
+    H_CLOSING_BRACKET,
+    H_CLOSING_PAREN,
+    H_PATTERN_START,
+    H_PATTERN_SUFFIX_START,
+    H_HASH_PATTERN,
+    H_ARRAY_OPERATOR,
+    H_EMPTY_VALUE,
+    H_HEREDOC_BODY,
+    H_HEREDOC_END,
+    H_HEREDOC_CONTENT,
+    H_HEREDOC_START,
+    H_TEST_OPERATOR,
+    H_SIMPLE_VARIABLE_NAME,
+    H_SPECIAL_VARIABLE_NAME,
+    H_VARIABLE_NAME,
+    H_RAW_DOLLAR,
+    H_REGEX,
+    H_EXTGLOB_PATTERN,
+    H_EXPANSION_WORD,
+    H_BRACE_EXPR_START,
+    HANDLER_COUNT,
+} handler_t;
+
+typedef uint32_t handler_mask_t;
+
+#define HANDLER(handler) ((handler_mask_t)1 << (handler))
+#define ALL_HANDLERS (HANDLER(HANDLER_COUNT) - 1)
+
+// The symbols each handler looks at
+static const symbol_mask_t HandlerSymbols[HANDLER_COUNT] = {
+    [H_CONCAT] = SYM(CONCAT) | SYM(CONCAT_REGEX),
+    [H_DOUBLE_QUOTE] = SYM(DOUBLE_QUOTE),
+    [H_SINGLE_QUOTE] = SYM(SINGLE_QUOTE),
+    [H_BACKTICK] = SYM(BACKTICK),
+    [H_NEWLINE] = SYM(NEWLINE),
+    [H_CLOSING_BRACE] = SYM(CLOSING_BRACE),
+    [H_BARE_DOLLAR] = SYM(BARE_DOLLAR),
+    [H_PEEK_BARE_DOLLAR] = SYM(PEEK_BARE_DOLLAR),
+    [H_BRACE_START] = SYM(BRACE_START),
+    [H_OPENING_PAREN] = SYM(OPENING_PAREN) | SYM(DOUBLE_OPENING_PAREN) |
+                        SYM(ZSH_EXTENDED_GLOB_FLAGS),
+    [H_OPENING_BRACKET] = SYM(OPENING_BRACKET) | SYM(TEST_COMMAND_START),
+    [H_CLOSING_BRACKET] = SYM(CLOSING_BRACKET) | SYM(TEST_COMMAND_END),
+    [H_CLOSING_PAREN] = SYM(CLOSING_PAREN) | SYM(CLOSING_DOUBLE_PAREN),
+    [H_PATTERN_START] = SYM(PATTERN_START),
+    [H_PATTERN_SUFFIX_START] = SYM(PATTERN_SUFFIX_START),
+    [H_HASH_PATTERN] = SYM(HASH_PATTERN) | SYM(DOUBLE_HASH_PATTERN),
+    [H_ARRAY_OPERATOR] = SYM(ARRAY_STAR_TOKEN) | SYM(ARRAY_AT_TOKEN),
+    [H_EMPTY_VALUE] = SYM(EMPTY_VALUE),
+    [H_HEREDOC_BODY] = SYM(SIMPLE_HEREDOC_BODY) | SYM(HEREDOC_BODY_BEGINNING),
+    [H_HEREDOC_END] = SYM(HEREDOC_END),
+    [H_HEREDOC_CONTENT] = SYM(HEREDOC_CONTENT),
+    [H_HEREDOC_START] = SYM(HEREDOC_START),
+    [H_TEST_OPERATOR] = SYM(TEST_OPERATOR),
+    [H_SIMPLE_VARIABLE_NAME] = SYM(SIMPLE_VARIABLE_NAME),
+    [H_SPECIAL_VARIABLE_NAME] = SYM(SPECIAL_VARIABLE_NAME),
+    [H_VARIABLE_NAME] = SYM(VARIABLE_NAME) | SYM(FILE_DESCRIPTOR) |
+                        SYM(HEREDOC_ARROW),
+    [H_RAW_DOLLAR] = SYM(BARE_DOLLAR),
+    [H_REGEX] = SYM(REGEX) | SYM(REGEX_NO_SLASH) | SYM(REGEX_NO_SPACE),
+    [H_EXTGLOB_PATTERN] = SYM(EXTGLOB_PATTERN),
+    [H_EXPANSION_WORD] = SYM(EXPANSION_WORD),
+    [H_BRACE_EXPR_START] = SYM(BRACE_EXPR_START),
+};
 
-    // Clear string exit flag at start and capture its previous value
-    bool was_just_exited_string = scanner->just_exited_string;
-    scanner->just_exited_string = false;
+// Handlers that stay active while the parser is recovering from an error: the
+// quote delimiters that open and close scanner contexts and the ends of
+// heredocs, which keep the context and heredoc stacks in step with the input.
+// The others would scan ahead speculatively for tokens that recovery almost
+// always throws away, at every position it tries.
+#define RECOVERY_HANDLERS                                                      \
+    (HANDLER(H_DOUBLE_QUOTE) | HANDLER(H_SINGLE_QUOTE) |                       \
+     HANDLER(H_BACKTICK) | HANDLER(H_HEREDOC_END))
+
+#define REGEX_SYMBOLS (SYM(REGEX) | SYM(REGEX_NO_SLASH) | SYM(REGEX_NO_SPACE))
+
+static inline handler_mask_t candidate_handlers(symbol_mask_t valid) {
+    // One test per handler rather than a loop over the valid symbols, which
+    // would take a data-dependent branch per symbol
+    handler_mask_t handlers = 0;
+    UNROLL_LOOP
+    for (uint32_t i = 0; i < HANDLER_COUNT; i++) {
+        handlers |= (handler_mask_t)((valid & HandlerSymbols[i]) != 0) << i;
+    }
+    if (valid & SYM(ERROR_RECOVERY)) {
+        handlers &= RECOVERY_HANDLERS;
+    }
+    if (valid & SYM(EXPANSION_WORD)) {
+        handlers &= ~HANDLER(H_TEST_OPERATOR);
+    }
+    if (valid & SYM(REGEX_NO_SLASH)) {
+        handlers &= ~HANDLER(H_VARIABLE_NAME);
+    }
+    if (valid & REGEX_SYMBOLS) {
+        handlers &= ~HANDLER(H_EXTGLOB_PATTERN);
+    }
+    return handlers;
+}
 
-    // FIXME: newline handling and exited string handling should go
-    bool was_just_newline = scanner->just_newline;
-    scanner->just_newline = false;
+// Handlers that always return (or jump to another handler) once entered, so
+// they can never be skipped based on the lookahead
+#define TERMINAL_HANDLERS                                                      \
+    (HANDLER(H_HEREDOC_BODY) | HANDLER(H_HEREDOC_END) |                        \
+     HANDLER(H_HEREDOC_CONTENT) | HANDLER(H_HEREDOC_START) |                   \
+     HANDLER(H_VARIABLE_NAME) | HANDLER(H_REGEX) |                             \
+     HANDLER(H_EXTGLOB_PATTERN) | HANDLER(H_EXPANSION_WORD))
+
+// Handlers that skip leading blanks before looking at the lookahead
+#define SPACE_HANDLERS                                                         \
+    (HANDLER(H_DOUBLE_QUOTE) | HANDLER(H_SINGLE_QUOTE) |                       \
+     HANDLER(H_BACKTICK) | HANDLER(H_NEWLINE) | HANDLER(H_CLOSING_BRACE) |     \
+     HANDLER(H_BARE_DOLLAR) | HANDLER(H_BRACE_START) |                         \
+     HANDLER(H_OPENING_PAREN) | HANDLER(H_OPENING_BRACKET) |                   \
+     HANDLER(H_CLOSING_BRACKET) | HANDLER(H_CLOSING_PAREN) |                   \
+     HANDLER(H_EMPTY_VALUE) | HANDLER(H_TEST_OPERATOR) |                       \
+     HANDLER(H_SIMPLE_VARIABLE_NAME) | HANDLER(H_SPECIAL_VARIABLE_NAME) |      \
+     HANDLER(H_RAW_DOLLAR) | HANDLER(H_BRACE_EXPR_START))
+
+// The handlers that can consume input, change state or return when they see
+// printable ASCII character `c`. Every other handler is a no-op for `c`.
+// Control characters and non-ASCII lookaheads are not classified, since the
+// wide character class functions may treat them as whitespace or letters.
+#define PRINTABLE_LOOKAHEAD_HANDLERS(c)                                        \
+    (TERMINAL_HANDLERS | HANDLER(H_PATTERN_START) * ((c) != '}') |             \
+     HANDLER(H_PATTERN_SUFFIX_START) * ((c) != '}') |                          \
+     HANDLER(H_CONCAT) * ((c) != ' ' && (c) != '<' && (c) != '>' &&            \
+                          (c) != ';' && (c) != '&' && (c) != '|' &&            \
+                          (c) != '{') |                                        \
+     SPACE_HANDLERS * ((c) == ' ') |                                           \
+     HANDLER(H_DOUBLE_QUOTE) * ((c) == '"') |                                  \
+     HANDLER(H_SINGLE_QUOTE) * ((c) == '\'') |                                 \
+     HANDLER(H_BACKTICK) * ((c) == '`') |                                      \
+     HANDLER(H_NEWLINE) * ((c) == '\\') |                                      \
+     HANDLER(H_CLOSING_BRACE) * ((c) == '}') |                                 \
+     HANDLER(H_BARE_DOLLAR) * ((c) == '$') |                                   \
+     HANDLER(H_PEEK_BARE_DOLLAR) * ((c) == '$') |                              \
+     HANDLER(H_BRACE_START) * ((c) == '{') |                                   \
+     HANDLER(H_OPENING_PAREN) * ((c) == '(') |                                 \
+     HANDLER(H_OPENING_BRACKET) * ((c) == '[') |                               \
+     HANDLER(H_CLOSING_BRACKET) * ((c) == ']') |                               \
+     HANDLER(H_CLOSING_PAREN) * ((c) == ')') |                                 \
+     HANDLER(H_HASH_PATTERN) * ((c) == '#') |                                  \
+     HANDLER(H_ARRAY_OPERATOR) * ((c) == '*' || (c) == '@') |                  \
+     HANDLER(H_EMPTY_VALUE) * ((c) == ';' || (c) == '&' || (c) == '}') |       \
+     HANDLER(H_TEST_OPERATOR) * ((c) == '\\' || (c) == '-' || (c) == '$') |    \
+     HANDLER(H_SIMPLE_VARIABLE_NAME) *                                         \
+         (IS_LOWER(c) || IS_UPPER(c) || (c) == '_') |                          \
+     HANDLER(H_SPECIAL_VARIABLE_NAME) *                                        \
+         ((c) == '*' || (c) == '@' || (c) == '?' || (c) == '-' ||              \
+          (c) == '!' || (c) == '#' || (c) == '$' || (c) == '_' ||              \
+          IS_DIGIT(c)) |                                                       \
+     HANDLER(H_RAW_DOLLAR) * ((c) == '$') |                                    \
+     HANDLER(H_BRACE_EXPR_START) * ((c) == '{'))
+
+#define LOOKAHEAD_HANDLERS(c)                                                  \
+    ((c) < ' ' || (c) > '~' ? ALL_HANDLERS : PRINTABLE_LOOKAHEAD_HANDLERS(c))
+
+#define LA2(c) LOOKAHEAD_HANDLERS(c), LOOKAHEAD_HANDLERS((c) + 1)
+#define LA8(c) LA2(c), LA2((c) + 2), LA2((c) + 4), LA2((c) + 6)
+#define LA32(c) LA8(c), LA8((c) + 8), LA8((c) + 16), LA8((c) + 24)
+
+static const handler_mask_t LookaheadHandlers[128] = {
+    LA32(0),
+    LA32(32),
+    LA32(64),
+    LA32(96),
+};
 
-    if ((valid_symbols[CONCAT] || valid_symbols[CONCAT_REGEX]) && !in_error_recovery(valid_symbols)) {
-        context_type_t ctx = get_current_context(scanner);
-#if DEBUG
-        fprintf(stderr,
-                "SCANNER: CONCAT handler lookeahead=%c "
-                "was_just_exited_string=%d was_just_newline=%d\n",
-                lexer->lookahead, was_just_exited_string, was_just_newline);
-#endif
-
-        if (!(lexer->lookahead == 0 || iswspace(lexer->lookahead) ||
-              lexer->lookahead == '>' || lexer->lookahead == '<' ||
-              (lexer->lookahead == ')' &&
-               (valid_symbols[CLOSING_PAREN] ||
-                valid_symbols[CLOSING_DOUBLE_PAREN])) ||
-              (lexer->lookahead == '(' && !valid_symbols[CONCAT_REGEX]) ||
-              lexer->lookahead == ';' ||
-              lexer->lookahead == '&' || lexer->lookahead == '|' ||
-              lexer->lookahead == '{' ||
-              // prevent concat over newline after string ends
-              (was_just_exited_string && lexer->lookahead == '\n') ||
-              (lexer->lookahead == '"' && ctx == CTX_STRING) ||
-              (was_just_newline) ||
-              // Prevent recursion on / pattern
-              (lexer->lookahead == '/' &&
-               ctx == CTX_PARAMETER_PATTERN_SUBSTITUTE) ||
-              (lexer->lookahead == '}' && in_parameter_expansion(scanner)) ||
-              // Split subscript out
-              (lexer->lookahead == ']' && valid_symbols[CLOSING_BRACKET]) ||
-              (lexer->lookahead == '[' &&
-               was_just_variable_name) || // Suppress CONCAT after $var when [
-              (lexer->lookahead == ':' &&
-               was_just_variable_name) ||  // Suppress CONCAT after $var when :
-              (lexer->lookahead == '`' && ctx == CTX_BACKTICK)
-              )) {
-            // follows
-#if DEBUG
-            fprintf(stderr, "SCANNER: CONCAT\n");
-#endif
+#undef LA2
+#undef LA8
+#undef LA32
 
-            TSSymbol concat_type = valid_symbols[CONCAT_REGEX] ? CONCAT_REGEX : CONCAT;
-            // So for a`b`, we want to return a concat. We check if the
-            // 2nd backtick has whitespace after it, and if it does we
-            // return concat.
-            if (lexer->lookahead == '`' && ctx != CTX_BACKTICK) {
-                lexer->mark_end(lexer);
-                advance(lexer);
+static inline handler_mask_t lookahead_handlers(int32_t lookahead) {
+    return lookahead >= 0 && lookahead < 128 ? LookaheadHandlers[lookahead]
+                                             : ALL_HANDLERS;
+}
+
+// Handlers that the current context rules out: hash patterns only occur
+// inside ${...} and extglob patterns never do
+static inline handler_mask_t context_handlers(context_type_t ctx) {
+    return context_is(ctx, CONTEXT_PARAMETER)
+               ? ALL_HANDLERS & ~HANDLER(H_EXTGLOB_PATTERN)
+               : ALL_HANDLERS & ~HANDLER(H_HASH_PATTERN);
+}
+
+// The contexts in which each ASCII lookahead ends a concatenation, as a
+// bitmap over the context types. CONCAT_STOPS_BY_STATE marks the lookaheads
+// that end it depending on the valid symbols or the previous token instead.
+#define IN_CONTEXT(ctx) ((uint16_t)1 << (ctx))
+#define ALL_CONTEXTS ((uint16_t)(IN_CONTEXT(CTX_RAW_STRING + 1) - 1))
+#define PARAMETER_CONTEXTS                                                     \
+    (IN_CONTEXT(CTX_PARAMETER) | IN_CONTEXT(CTX_PARAMETER_PATTERN_SUFFIX) |    \
+     IN_CONTEXT(CTX_PARAMETER_PATTERN_SUBSTITUTE))
+#define CONCAT_STOPS_BY_STATE ((uint16_t)1 << 15)
+
+#define CONCAT_STOP_CONTEXTS(c)                                                \
+    ((c) == '\0' || ((c) >= '\t' && (c) <= '\r') || (c) == ' ' ||             \
+             (c) == '<' || (c) == '>' || (c) == ';' || (c) == '&' ||           \
+             (c) == '|' || (c) == '{'                                          \
+         ? ALL_CONTEXTS                                                        \
+     : (c) == '"' ? IN_CONTEXT(CTX_STRING)                                     \
+     : (c) == '`' ? IN_CONTEXT(CTX_BACKTICK)                                   \
+     : (c) == '/' ? IN_CONTEXT(CTX_PARAMETER_PATTERN_SUBSTITUTE)               \
+     : (c) == '}' ? PARAMETER_CONTEXTS                                         \
+     : (c) == '(' || (c) == ')' || (c) == '[' || (c) == ']' || (c) == ':'      \
+         ? CONCAT_STOPS_BY_STATE                                               \
+         : 0)
+
+#define CS2(c) CONCAT_STOP_CONTEXTS(c), CONCAT_STOP_CONTEXTS((c) + 1)
+#define CS8(c) CS2(c), CS2((c) + 2), CS2((c) + 4), CS2((c) + 6)
+#define CS32(c) CS8(c), CS8((c) + 8), CS8((c) + 16), CS8((c) + 24)
+
+static const uint16_t ConcatStopContexts[128] = {
+    CS32(0),
+    CS32(32),
+    CS32(64),
+    CS32(96),
+};
+
+#undef CS2
+#undef CS8
+#undef CS32
+
+// Whether lookahead `c` ends the concatenation before it instead of being
+// concatenated to it
+static inline bool concat_stops(int32_t c, context_type_t ctx,
+                                const bool *valid_symbols,
+                                bool was_just_variable_name) {
+    if (c < 0 || c >= 128) {
+        return is_space(c);
+    }
+    uint16_t stops = ConcatStopContexts[c];
+    if (stops & IN_CONTEXT(ctx)) {
+        return true;
+    }
+    if (!(stops & CONCAT_STOPS_BY_STATE)) {
+        return false;
+    }
+    switch (c) {
+    case ')':
+        return valid_symbols[CLOSING_PAREN] ||
+               valid_symbols[CLOSING_DOUBLE_PAREN];
+    case '(':
+        return !valid_symbols[CONCAT_REGEX];
+    case ']':
+        // Split subscript out
+        return valid_symbols[CLOSING_BRACKET];
+    default:
+        // Suppress CONCAT after $var when [ or :
+        return was_just_variable_name;
+    }
+}
+
+// Character classes of the regex scanner. Word characters are the ones that
+// do not make a REGEX_NO_SPACE word a regex on their own.
+typedef enum {
+    REGEX_CHAR_OTHER,
+    REGEX_CHAR_WORD, // alphanumeric, '-' and '_'
+    REGEX_CHAR_SPACE,
+    REGEX_CHAR_ESCAPE,
+    REGEX_CHAR_END, // '\0', including the end of the input
+    REGEX_CHAR_OPEN_PAREN,
+    REGEX_CHAR_OPEN_BRACKET,
+    REGEX_CHAR_OPEN_BRACE,
+    REGEX_CHAR_CLOSE_PAREN,
+    REGEX_CHAR_CLOSE_BRACKET,
+    REGEX_CHAR_CLOSE_BRACE,
+    REGEX_CHAR_QUOTE,
+    REGEX_CHAR_DOLLAR,
+    REGEX_CHAR_SLASH,
+} regex_char_t;
+
+#define REGEX_WORD_CHARS(c)                                                    \
+    (IS_LOWER(c) || IS_UPPER(c) || IS_DIGIT(c) || (c) == '-' || (c) == '_')
+
+#define REGEX_CHAR_CLASS(c)                                                    \
+    ((c) == '\0'                      ? REGEX_CHAR_END                         \
+     : ((c) >= '\t' && (c) <= '\r') || (c) == ' ' ? REGEX_CHAR_SPACE           \
+     : (c) == '\\'                    ? REGEX_CHAR_ESCAPE                      \
+     : (c) == '('                     ? REGEX_CHAR_OPEN_PAREN                  \
+     : (c) == '['                     ? REGEX_CHAR_OPEN_BRACKET                \
+     : (c) == '{'                     ? REGEX_CHAR_OPEN_BRACE                  \
+     : (c) == ')'                     ? REGEX_CHAR_CLOSE_PAREN                 \
+     : (c) == ']'                     ? REGEX_CHAR_CLOSE_BRACKET               \
+     : (c) == '}'                     ? REGEX_CHAR_CLOSE_BRACE                 \
+     : (c) == '\''                    ? REGEX_CHAR_QUOTE                       \
+     : (c) == '$'                     ? REGEX_CHAR_DOLLAR                      \
+     : (c) == '/'                     ? REGEX_CHAR_SLASH                       \
+     : REGEX_WORD_CHARS(c)            ? REGEX_CHAR_WORD                        \
+                                      : REGEX_CHAR_OTHER)
+
+#define RC2(c) REGEX_CHAR_CLASS(c), REGEX_CHAR_CLASS((c) + 1)
+#define RC8(c) RC2(c), RC2((c) + 2), RC2((c) + 4), RC2((c) + 6)
+#define RC32(c) RC8(c), RC8((c) + 8), RC8((c) + 16), RC8((c) + 24)
+
+static const uint8_t RegexCharClasses[128] = {
+    RC32(0),
+    RC32(32),
+    RC32(64),
+    RC32(96),
+};
+
+#undef RC2
+#undef RC8
+#undef RC32
+
+static inline regex_char_t regex_char_class(int32_t c) {
+    if (c >= 0 && c < 128) {
+        return (regex_char_t)RegexCharClasses[c];
+    }
+    return iswspace(c)   ? REGEX_CHAR_SPACE
+           : iswalnum(c) ? REGEX_CHAR_WORD
+                         : REGEX_CHAR_OTHER;
+}
+
+// The classes that REGEX_NO_SLASH consumes as part of the regex with no other
+// effect, and REGEX also '/', so runs of them are taken in one go
+#define REGEX_CHAR(class) (1u << (class))
+#define REGEX_PLAIN_CHARS                                                      \
+    (REGEX_CHAR(REGEX_CHAR_OTHER) | REGEX_CHAR(REGEX_CHAR_WORD) |              \
+     REGEX_CHAR(REGEX_CHAR_DOLLAR))
+
+// Groups nested deeper than this are not taken for a regex. Each open group
+// lets the scan go on past spaces until the end of the line, so a long line
+// of `(` would otherwise be read to its end from every position.
+#define MAX_REGEX_GROUP_DEPTH 32
+
+typedef struct {
+    bool advanced_once;
+    bool found_non_alnumdollarunderdash;
+    bool last_was_escape;
+    bool in_single_quote;
+    uint32_t paren_depth;
+    uint32_t bracket_depth;
+    uint32_t brace_depth;
+} RegexState;
+
+// The part of the regex state machine common to every regex token: track
+// the nesting of brackets and whether the previous character was a
+// backslash. Returns whether `class` closes a bracket that was never opened,
+// which ends the regex.
+static inline bool regex_transition(RegexState *state, regex_char_t class) {
+    bool was_escape = state->last_was_escape;
+    state->last_was_escape = false;
+    switch (class) {
+    case REGEX_CHAR_ESCAPE:
+        state->last_was_escape = true;
+        return false;
+    case REGEX_CHAR_OPEN_PAREN:
+        state->paren_depth++;
+        return false;
+    case REGEX_CHAR_OPEN_BRACKET:
+        state->bracket_depth++;
+        return false;
+    case REGEX_CHAR_OPEN_BRACE:
+        if (!was_escape) {
+            state->brace_depth++;
+        }
+        return false;
+    case REGEX_CHAR_CLOSE_PAREN:
+        return state->paren_depth-- == 0;
+    case REGEX_CHAR_CLOSE_BRACKET:
+        return state->bracket_depth-- == 0;
+    case REGEX_CHAR_CLOSE_BRACE:
+        return state->brace_depth-- == 0;
+    default:
+        return false;
+    }
+}
+
+// Scan the operand of =~ as REGEX, REGEX_NO_SLASH or REGEX_NO_SPACE. The
+// characters are consumed the way the first of REGEX, REGEX_NO_SLASH and
+// REGEX_NO_SPACE that is valid requires.
+static bool scan_regex(Scanner *scanner, TSLexer *lexer,
+                       const bool *valid_symbols) {
+    if (lexer->lookahead == '$' && valid_symbols[REGEX_NO_SLASH]) {
+        lexer->mark_end(lexer);
+        advance(lexer);
+        if (lexer->lookahead == '(') {
+            return false;
+        }
+    }
+
+#if DEBUG
+    fprintf(stderr, "DEBUG: regex scan start\n");
+#endif
+
+    lexer->mark_end(lexer);
+
+    enum TokenType variant = valid_symbols[REGEX]          ? REGEX
+                             : valid_symbols[REGEX_NO_SLASH] ? REGEX_NO_SLASH
+                                                           : REGEX_NO_SPACE;
+    uint32_t plain_chars = variant == REGEX ? REGEX_PLAIN_CHARS |
+                                                  REGEX_CHAR(REGEX_CHAR_SLASH)
+                           : variant == REGEX_NO_SLASH ? REGEX_PLAIN_CHARS
+                                                       : 0;
+    RegexState state = {false, false, false, false, 0, 0, 0};
+    for (;;) {
+        regex_char_t class = regex_char_class(lexer->lookahead);
+        if (class == REGEX_CHAR_END) {
+            return false;
+        }
+        if (class == REGEX_CHAR_QUOTE) {
+            // Enter or exit a single-quoted string
+            if (state.in_single_quote) {
+#if DEBUG
+                fprintf(stderr, "DEBUG: regex scan exit raw string\n");
+#endif
+                exit_context(scanner, CTX_RAW_STRING);
+            } else {
+#if DEBUG
+                fprintf(stderr, "DEBUG: regex scan entering raw string\n");
+#endif
+                enter_context(scanner, CTX_RAW_STRING);
+            }
+            state.in_single_quote = !state.in_single_quote;
+            advance(lexer);
+            lexer->mark_end(lexer);
+            state.advanced_once = true;
+            state.last_was_escape = false;
+            continue;
+        }
+        // The operand of =~ is a single word, so an unquoted newline ends it
+        // like a closer that was never opened, and a group still open there
+        // is never closed. Going on would read the rest of the input from
+        // every position the regex is tried at. Outside groups,
+        // REGEX_NO_SPACE already ends at any space below.
+        if (lexer->lookahead == '\n' && !state.in_single_quote &&
+            !state.last_was_escape) {
+            if (state.paren_depth > 0) {
+                return false;
+            }
+            if (variant != REGEX_NO_SPACE) {
+                break;
+            }
+        }
+        if (regex_transition(&state, class)) {
+            break;
+        }
+        if (state.paren_depth > MAX_REGEX_GROUP_DEPTH) {
+            return false;
+        }
+
+        if (plain_chars & REGEX_CHAR(class)) {
+            // Every character of the run would be marked as the token end
+            do {
+                advance(lexer);
+            } while (plain_chars &
+                     REGEX_CHAR(regex_char_class(lexer->lookahead)));
+            lexer->mark_end(lexer);
+            state.advanced_once = true;
+            continue;
+        }
+
+        bool was_space = !state.in_single_quote && class == REGEX_CHAR_SPACE;
+        if (variant == REGEX) {
+            advance(lexer);
+            state.advanced_once = true;
+            if (!was_space || state.paren_depth > 0) {
+                lexer->mark_end(lexer);
+            }
+        } else if (variant == REGEX_NO_SLASH) {
+            if (class == REGEX_CHAR_SLASH) {
+                lexer->mark_end(lexer);
+                lexer->result_symbol = REGEX_NO_SLASH;
+                return state.advanced_once;
+            }
+            advance(lexer);
+            state.advanced_once = true;
+            if (class == REGEX_CHAR_ESCAPE) {
+                if (!lexer->eof(lexer) && lexer->lookahead != '[') {
+                    advance(lexer);
+                    lexer->mark_end(lexer);
+                }
+            } else if (!was_space) {
+                lexer->mark_end(lexer);
+            }
+        } else if (class == REGEX_CHAR_ESCAPE) {
+            state.found_non_alnumdollarunderdash = true;
+            advance(lexer);
+            if (!lexer->eof(lexer)) {
+                advance(lexer);
+            }
+        } else if (class == REGEX_CHAR_DOLLAR) {
+            lexer->mark_end(lexer);
+            advance(lexer);
+            // do not parse a command substitution
+            if (lexer->lookahead == '(') {
+                return false;
+            }
+            // end $ always means regex, e.g. 99999999$
+            if (regex_char_class(lexer->lookahead) == REGEX_CHAR_SPACE) {
+                lexer->result_symbol = REGEX_NO_SPACE;
+                lexer->mark_end(lexer);
+                return true;
+            }
+        } else {
+            if (was_space && state.paren_depth == 0) {
+                lexer->mark_end(lexer);
+                lexer->result_symbol = REGEX_NO_SPACE;
+                return state.found_non_alnumdollarunderdash;
+            }
+            if (class != REGEX_CHAR_WORD) {
+                state.found_non_alnumdollarunderdash = true;
+            }
+            advance(lexer);
+        }
+    }
+
+    lexer->result_symbol = valid_symbols[REGEX_NO_SLASH]   ? REGEX_NO_SLASH
+                           : valid_symbols[REGEX_NO_SPACE] ? REGEX_NO_SPACE
+                                                           : REGEX;
+    if ((valid_symbols[REGEX] || valid_symbols[REGEX_NO_SPACE]) &&
+        !state.advanced_once) {
+#if DEBUG
+        fprintf(stderr, "DEBUG: regex not valid returning false\n");
+#endif
+        return false;
+    }
+
+#if DEBUG
+    fprintf(stderr, "DEBUG: regex scan returning regex\n");
+#endif
+    return true;
+}
+
+// Whether `handler` is a candidate and could act on the current lookahead
+#define CAN_TRY_HANDLER(handler)                                               \
+    ((handlers & HANDLER(handler)) &&                                          \
+     (lookahead_handlers(lexer->lookahead) & HANDLER(handler)))
+
+#ifdef TREE_SITTER_ZSH_SCANNER_STATS
+
+// Counters of the handlers tried by scans on this thread. A handler is
+// credited with the characters consumed from the point it is tried until the
+// next handler is tried or the scan returns, and with an accept or reject
+// depending on whether the scan it was the last handler of produced a token.
+// A reject after consuming characters is a backtrack: the runtime rewinds the
+// lexer and those characters are read again by the internal lexer.
+typedef struct {
+    uint64_t invocations;
+    uint64_t accepts;
+    uint64_t rejects;
+    uint64_t characters;
+    uint64_t backtracks;
+    uint64_t backtracked_characters;
+} HandlerStats;
+
+static const char *const HandlerNames[HANDLER_COUNT] = {
+    [H_CONCAT] = "concat",
+    [H_DOUBLE_QUOTE] = "double_quote",
+    [H_SINGLE_QUOTE] = "single_quote",
+    [H_BACKTICK] = "backtick",
+    [H_NEWLINE] = "newline",
+    [H_CLOSING_BRACE] = "closing_brace",
+    [H_BARE_DOLLAR] = "bare_dollar",
+    [H_PEEK_BARE_DOLLAR] = "peek_bare_dollar",
+    [H_BRACE_START] = "brace_start",
+    [H_OPENING_PAREN] = "opening_paren",
+    [H_OPENING_BRACKET] = "opening_bracket",
+    [H_CLOSING_BRACKET] = "closing_bracket",
+    [H_CLOSING_PAREN] = "closing_paren",
+    [H_PATTERN_START] = "pattern_start",
+    [H_PATTERN_SUFFIX_START] = "pattern_suffix_start",
+    [H_HASH_PATTERN] = "hash_pattern",
+    [H_ARRAY_OPERATOR] = "array_operator",
+    [H_EMPTY_VALUE] = "empty_value",
+    [H_HEREDOC_BODY] = "heredoc_body",
+    [H_HEREDOC_END] = "heredoc_end",
+    [H_HEREDOC_CONTENT] = "heredoc_content",
+    [H_HEREDOC_START] = "heredoc_start",
+    [H_TEST_OPERATOR] = "test_operator",
+    [H_SIMPLE_VARIABLE_NAME] = "simple_variable_name",
+    [H_SPECIAL_VARIABLE_NAME] = "special_variable_name",
+    [H_VARIABLE_NAME] = "variable_name",
+    [H_RAW_DOLLAR] = "raw_dollar",
+    [H_REGEX] = "regex",
+    [H_EXTGLOB_PATTERN] = "extglob_pattern",
+    [H_EXPANSION_WORD] = "expansion_word",
+    [H_BRACE_EXPR_START] = "brace_expr_start",
+};
+
+static SCANNER_THREAD_LOCAL HandlerStats stats_handlers[HANDLER_COUNT];
+static SCANNER_THREAD_LOCAL uint64_t stats_scans;
+static SCANNER_THREAD_LOCAL uint32_t stats_handler = HANDLER_COUNT;
+static SCANNER_THREAD_LOCAL uint64_t stats_handler_start;
+
+// Closes the handler being tried, if any, as rejected or accepted
+static inline void stats_finish_handler(bool accepted) {
+    if (stats_handler == HANDLER_COUNT) {
+        return;
+    }
+    HandlerStats *stats = &stats_handlers[stats_handler];
+    uint64_t characters = scan_characters - stats_handler_start;
+    stats->characters += characters;
+    if (accepted) {
+        stats->accepts++;
+    } else {
+        stats->rejects++;
+        if (characters > 0) {
+            stats->backtracks++;
+            stats->backtracked_characters += characters;
+        }
+    }
+    stats_handler = HANDLER_COUNT;
+}
+
+static inline void stats_try_handler(handler_t handler) {
+    stats_finish_handler(false);
+    stats_handlers[handler].invocations++;
+    stats_handler = handler;
+    stats_handler_start = scan_characters;
+}
+
+#endif
+
+#ifdef TREE_SITTER_ZSH_SCANNER_TRACE
+
+static inline void trace_event(Scanner *scanner, uint8_t symbol) {
+    TraceRing *ring = &scanner->trace;
+    TraceEvent *event = &ring->events[ring->count++ % SCANNER_TRACE_SIZE];
+    uint32_t depth = scanner->context_stack.size;
+    uint64_t offset = scan_characters - ring->scan_start;
+    event->handler = ring->handler;
+    event->symbol = symbol;
+    event->context = scanner->context_stack.top;
+    event->depth = depth > UINT8_MAX ? UINT8_MAX : (uint8_t)depth;
+    event->offset = offset > UINT32_MAX ? UINT32_MAX : (uint32_t)offset;
+}
+
+// The scanner whose ring tree_sitter_zsh_scanner_trace exports
+static SCANNER_THREAD_LOCAL Scanner *trace_scanner;
+
+static inline void trace_scan_start(Scanner *scanner) {
+    trace_scanner = scanner;
+    scanner->trace.handler = HANDLER_COUNT;
+    scanner->trace.scan_start = scan_characters;
+}
+
+static inline void trace_scan_end(Scanner *scanner, TSLexer *lexer,
+                                  bool result) {
+    trace_event(scanner, result ? (uint8_t)lexer->result_symbol
+                                : (uint8_t)TRACE_REJECT);
+}
+
+#endif
+
+#if defined(TREE_SITTER_ZSH_SCANNER_STATS) ||                                  \
+    defined(TREE_SITTER_ZSH_SCANNER_TRACE)
+
+static inline bool note_handler(Scanner *scanner, handler_t handler) {
+#ifdef TREE_SITTER_ZSH_SCANNER_STATS
+    stats_try_handler(handler);
+#endif
+#ifdef TREE_SITTER_ZSH_SCANNER_TRACE
+    scanner->trace.handler = (uint8_t)handler;
+    trace_event(scanner, TRACE_TRY);
+#endif
+    (void)scanner;
+    return true;
+}
+
+#define TRY_HANDLER(handler)                                                   \
+    (CAN_TRY_HANDLER(handler) && note_handler(scanner, handler))
+
+#else
+
+#define TRY_HANDLER(handler) CAN_TRY_HANDLER(handler)
+
+#endif
+
+// Enters the context of `quote` when it opens one here, after blanks, or
+// exits it when it closes the current one
+static bool scan_quote(Scanner *scanner, TSLexer *lexer, int32_t quote,
+                       context_type_t context, enum TokenType symbol) {
+    if (get_current_context(scanner) != context) {
+        skip_ws(lexer);
+        if (lexer->lookahead != quote) {
+            return false;
+        }
+        enter_context(scanner, context);
+    } else if (lexer->lookahead == quote) {
+        exit_context(scanner, context);
+        // Set the flag to indicate we just exited a string
+        scanner->just_exited_string = context != CTX_BACKTICK;
+    } else {
+        return false;
+    }
+#if DEBUG
+    fprintf(stderr, "SCANNER: %s %s context\n",
+            get_current_context(scanner) == context ? "Entering" : "Exiting",
+            TokenNames[symbol]);
+#endif
+    advance(lexer);
+    lexer->mark_end(lexer);
+    lexer->result_symbol = symbol;
+    return true;
+}
+
+// The scan while the parser is recovering from an error, which only looks for
+// the tokens of RECOVERY_HANDLERS. Recovery tries the scanner at every
+// position it skips over with nearly every symbol valid, so this keeps each
+// of those calls down to a look at the lookahead.
+static bool scan_error_recovery(Scanner *scanner, TSLexer *lexer,
+                                handler_mask_t handlers) {
+    if (TRY_HANDLER(H_DOUBLE_QUOTE) &&
+        scan_quote(scanner, lexer, '"', CTX_STRING, DOUBLE_QUOTE)) {
+        return true;
+    }
+    if (TRY_HANDLER(H_SINGLE_QUOTE) &&
+        scan_quote(scanner, lexer, '\'', CTX_RAW_STRING, SINGLE_QUOTE)) {
+        return true;
+    }
+    if (TRY_HANDLER(H_BACKTICK) &&
+        scan_quote(scanner, lexer, '`', CTX_BACKTICK, BACKTICK)) {
+        return true;
+    }
+    if (TRY_HANDLER(H_HEREDOC_END) && scanner->heredocs.size > 0) {
+        Heredoc *heredoc = array_back(&scanner->heredocs);
+        if (scan_heredoc_end_identifier(heredoc, lexer)) {
+            delete_heredoc(heredoc);
+            array_pop(&scanner->heredocs);
+            lexer->result_symbol = HEREDOC_END;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
+#if DEBUG
+    fprintf(stderr, "SCANNER: invoked lookahead='%c'\n", lexer->lookahead);
+    for (int i = 0; i <= ERROR_RECOVERY; i++) {
+        if (valid_symbols[i]) {
+            fprintf(stderr, "SCANNER: valid symbol: %s\n", TokenNames[i]);
+        }
+    }
+#endif
+
+    // Clear flag at start and capture its previous value
+    bool was_just_variable_name = scanner->just_returned_variable_name;
+    scanner->just_returned_variable_name = false;
+
+    bool was_just_bare_dollar = scanner->just_returned_bare_dollar;
+    scanner->just_returned_bare_dollar = false;
+
+    // Clear string exit flag at start
+    scanner->just_exited_string = false;
+
+    // FIXME: newline handling and exited string handling should go
+    bool was_just_newline = scanner->just_newline;
+    scanner->just_newline = false;
+
+    symbol_mask_t valid = pack_valid_symbols(valid_symbols);
+    handler_mask_t handlers = candidate_handlers(valid);
+
+    // Every handler that could act on this lookahead in this context is
+    // filtered out, and the rest leave the lexer untouched, so nothing further
+    // can match
+    if (!(handlers & lookahead_handlers(lexer->lookahead) &
+          context_handlers(get_current_context(scanner)))) {
+        return false;
+    }
+
+    if (valid & SYM(ERROR_RECOVERY)) {
+        return scan_error_recovery(scanner, lexer, handlers);
+    }
+
+    if (TRY_HANDLER(H_CONCAT)) {
+        context_type_t ctx = get_current_context(scanner);
+#if DEBUG
+        fprintf(stderr,
+                "SCANNER: CONCAT handler lookeahead=%c "
+                "was_just_newline=%d\n",
+                lexer->lookahead, was_just_newline);
+#endif
+
+        if (!was_just_newline &&
+            !concat_stops(lexer->lookahead, ctx, valid_symbols,
+                          was_just_variable_name)) {
+            // follows
+#if DEBUG
+            fprintf(stderr, "SCANNER: CONCAT\n");
+#endif
+
+            TSSymbol concat_type = valid_symbols[CONCAT_REGEX] ? CONCAT_REGEX : CONCAT;
+            // So for a`b`, we want to return a concat. We check if the
+            // 2nd backtick has whitespace after it, and if it does we
+            // return concat.
+            if (lexer->lookahead == '`' && ctx != CTX_BACKTICK) {
+                lexer->mark_end(lexer);
+                advance(lexer);
                 bool was_escape = false;
                 while ((lexer->lookahead != '`' || was_escape) && !lexer->eof(lexer)) {
                     advance(lexer);
@@ -733,7 +2126,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
                 if (lexer->lookahead == '`') {
                     advance(lexer);
                 }
-                if ((iswspace(lexer->lookahead) &&
+                if ((is_space(lexer->lookahead) &&
                      lexer->lookahead != '\n' // HACK
                      ) ||
                     lexer->eof(lexer)) {
@@ -767,99 +2160,19 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
     }
 
     // Handle string context tracking
-    if (valid_symbols[DOUBLE_QUOTE]) {
-        if (get_current_context(scanner) != CTX_STRING) {
-            skip_ws(lexer);
-
-            if (lexer->lookahead == '"') {
-                // Entering a string context
-                enter_context(scanner, CTX_STRING);
-#if DEBUG
-                fprintf(stderr, "SCANNER: Entering string context\n");
-#endif
-                advance(lexer);
-                lexer->mark_end(lexer);
-                lexer->result_symbol = DOUBLE_QUOTE;
-                return true;
-            }
-        } else if (lexer->lookahead == '"') {
-            // Exiting a string context
-            exit_context(scanner, CTX_STRING);
-            // Set the flag to indicate we just exited a string
-            was_just_exited_string = scanner->just_exited_string = true;
-
-#if DEBUG
-            fprintf(stderr, "SCANNER: Exiting string context\n");
-#endif
-
-            advance(lexer);
-            lexer->mark_end(lexer);
-            lexer->result_symbol = DOUBLE_QUOTE;
-            return true;
-        }
+    if (TRY_HANDLER(H_DOUBLE_QUOTE) &&
+        scan_quote(scanner, lexer, '"', CTX_STRING, DOUBLE_QUOTE)) {
+        return true;
     }
 
-    if (valid_symbols[SINGLE_QUOTE]) {
-        if (get_current_context(scanner) != CTX_RAW_STRING) {
-            skip_ws(lexer);
-
-            if (lexer->lookahead == '\'') {
-                // Entering a string context
-                enter_context(scanner, CTX_RAW_STRING);
-#if DEBUG
-                fprintf(stderr, "SCANNER: Entering raw string context\n");
-#endif
-                advance(lexer);
-                lexer->mark_end(lexer);
-                lexer->result_symbol = SINGLE_QUOTE;
-                return true;
-            }
-        } else if (lexer->lookahead == '\'') {
-            // Exiting a string context
-            exit_context(scanner, CTX_RAW_STRING);
-            // Set the flag to indicate we just exited a string
-            was_just_exited_string = scanner->just_exited_string = true;
-
-#if DEBUG
-            fprintf(stderr, "SCANNER: Exiting raw string context\n");
-#endif
-
-            advance(lexer);
-            lexer->mark_end(lexer);
-            lexer->result_symbol = SINGLE_QUOTE;
-            return true;
-        }
+    if (TRY_HANDLER(H_SINGLE_QUOTE) &&
+        scan_quote(scanner, lexer, '\'', CTX_RAW_STRING, SINGLE_QUOTE)) {
+        return true;
     }
 
-    // Handle string context tracking
-    if (valid_symbols[BACKTICK]) {
-        if (get_current_context(scanner) != CTX_BACKTICK) {
-            skip_ws(lexer);
-
-            if (lexer->lookahead == '`') {
-                // Entering a string context
-                enter_context(scanner, CTX_BACKTICK);
-#if DEBUG
-                fprintf(stderr, "SCANNER: Entering backtick context\n");
-#endif
-                advance(lexer);
-                lexer->mark_end(lexer);
-                lexer->result_symbol = BACKTICK;
-                return true;
-            }
-        } else if (lexer->lookahead == '`') {
-            // Exiting a string context
-            exit_context(scanner, CTX_BACKTICK);
-
-#if DEBUG
-            fprintf(stderr, "SCANNER: Exiting backtick context\n");
-#endif
-
-            advance(lexer);
-            lexer->mark_end(lexer);
-            lexer->result_symbol = BACKTICK;
-            return true;
-        }
+    if (TRY_HANDLER(H_BACKTICK) &&
+        scan_quote(scanner, lexer, '`', CTX_BACKTICK, BACKTICK)) {
+        return true;
     }
 
 #if DEBUG
@@ -869,14 +2182,14 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
 #endif
 
     // Resolve and absorb newlines when requested
-    if (valid_symbols[NEWLINE] && !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_NEWLINE)) {
 #if DEBUG
         fprintf(stderr, "SCANNER: NEWLINE handler, lookahead='%c'\n",
                 lexer->lookahead);
 #endif
         skip_ws(lexer);
         if (lexer->lookahead == '\n') {
-            while (iswspace(lexer->lookahead)) {
+            while (is_space(lexer->lookahead)) {
                 skip(lexer);
             }
             was_just_newline = scanner->just_newline = true;
@@ -900,7 +2213,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
 
     // Dedicated context-aware brace handler - handles closing braces for
     // different contexts
-    if (valid_symbols[CLOSING_BRACE] && !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_CLOSING_BRACE)) {
         context_type_t active = get_current_context(scanner);
 
         skip_wsnl(lexer);
@@ -951,7 +2264,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
     }
 
     // Handle BARE_DOLLAR for parameter expansion: $ followed by {
-    if (valid_symbols[BARE_DOLLAR] && !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_BARE_DOLLAR)) {
 #if DEBUG
         fprintf(stderr,
                 "SCANNER: Entering BARE_DOLLAR handler, lookahead='%c'\n",
@@ -966,7 +2279,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
                 "valid_symbols[CONCAT]=%d, lookahead='%c'\n",
                 valid_symbols[CONCAT], lexer->lookahead);
 #endif
-        if (!valid_symbols[CONCAT] && iswspace(lexer->lookahead)) {
+        if (!valid_symbols[CONCAT] && is_space(lexer->lookahead)) {
 #if DEBUG
             fprintf(stderr, "SCANNER: BARE_DOLLAR skipping whitespace\n");
 #endif
@@ -997,7 +2310,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
     // Must be after BARE_DOLLAR to avoid conflict
     // Handle PEEK_BARE_DOLLAR for concatenation: check if next non-whitespace
     // token is $ without consuming
-    if (valid_symbols[PEEK_BARE_DOLLAR] && !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_PEEK_BARE_DOLLAR)) {
 #if DEBUG
         fprintf(stderr,
                 "SCANNER: Entering PEEK_BARE_DOLLAR handler, lookahead='%c'\n",
@@ -1020,7 +2333,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
 
     // Handle BRACE_START - if we're in parameter expansion context, this is
     // part of ${
-    if (valid_symbols[BRACE_START] && !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_BRACE_START)) {
         if (lexer->lookahead == '{') {
             if (was_just_bare_dollar) {
                 advance(lexer);
@@ -1046,9 +2359,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
     }
 
     // Handle OPENING_PAREN after BARE_DOLLAR
-    if ((valid_symbols[OPENING_PAREN] || valid_symbols[DOUBLE_OPENING_PAREN] ||
-         valid_symbols[ZSH_EXTENDED_GLOB_FLAGS]) &&
-        !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_OPENING_PAREN)) {
         skip_ws(lexer);
         // If a regex is allowed, only proceed with analysis if a bare_dollar preceedes
         if (lexer->lookahead == '(' && (valid_symbols[OPENING_PAREN] &&
@@ -1090,25 +2401,13 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
             } else if ((valid_symbols[OPENING_PAREN] ||
                         valid_symbols[ZSH_EXTENDED_GLOB_FLAGS]) && !valid_symbols[REGEX_NO_SPACE]) {
                 // Handle ZSH_EXTENDED_GLOB_FLAGS - (#flags) patterns
-                if (lexer->lookahead == '#' &&
+                if (ZSH_EXTENSIONS && lexer->lookahead == '#' &&
                     valid_symbols[ZSH_EXTENDED_GLOB_FLAGS]) {
                     advance(lexer);
 
                     // Check for valid flag characters
                     bool found_flags = false;
-                    while (
-                        lexer->lookahead &&
-                        (iswalnum(lexer->lookahead) ||
-                         lexer->lookahead == '.' || lexer->lookahead == 'i' ||
-                         lexer->lookahead == 'q' || lexer->lookahead == 'b' ||
-                         lexer->lookahead == 'm' || lexer->lookahead == 'n' ||
-                         lexer->lookahead == 's' || lexer->lookahead == 'B' ||
-                         lexer->lookahead == 'I' || lexer->lookahead == 'N' ||
-                         lexer->lookahead == 'U' || lexer->lookahead == 'X' ||
-                         lexer->lookahead == 'c' || lexer->lookahead == 'e' ||
-                         lexer->lookahead == 'l' || lexer->lookahead == 'f' ||
-                         lexer->lookahead == 'a' || lexer->lookahead == 'C' ||
-                         lexer->lookahead == 'o')) {
+                    while (is_glob_flag(lexer->lookahead)) {
                         found_flags = true;
                         advance(lexer);
                     }
@@ -1140,8 +2439,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
         }
     }
 
-    if ((valid_symbols[OPENING_BRACKET] || valid_symbols[TEST_COMMAND_START]) &&
-        !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_OPENING_BRACKET)) {
 #if DEBUG
         fprintf(stderr,
                 "DEBUG: CHECKING TEST_COMMAND_START=%d OPENING_BRACKET=%d "
@@ -1201,8 +2499,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
     }
 
     // Handle TEST_COMMAND_END ]]
-    if ((valid_symbols[TEST_COMMAND_END] || valid_symbols[CLOSING_BRACKET]) &&
-        !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_CLOSING_BRACKET)) {
         skip_ws(lexer);
         if (lexer->lookahead == ']') {
             advance(lexer);
@@ -1234,8 +2531,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
         }
     }
 
-    if ((valid_symbols[CLOSING_PAREN] || valid_symbols[CLOSING_DOUBLE_PAREN]) &&
-        !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_CLOSING_PAREN)) {
         skip_ws(lexer);
         if (lexer->lookahead == ')') {
             advance(lexer);
@@ -1270,7 +2566,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
 
     // Handle PATTERN_START - emitted after pattern operators in parameter
     // expansions
-    if (valid_symbols[PATTERN_START] && !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_PATTERN_START)) {
         if (get_current_context(scanner) == CTX_PARAMETER &&
             lexer->lookahead !=
                 '}') { // Don't emit if expansion is about to end
@@ -1297,8 +2593,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
 
     // Handle PATTERN_SUFFIX_START - emitted after pattern operators in
     // parameter expansions
-    if (valid_symbols[PATTERN_SUFFIX_START] &&
-        !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_PATTERN_SUFFIX_START)) {
         if (get_current_context(scanner) == CTX_PARAMETER &&
             lexer->lookahead !=
                 '}') { // Don't emit if expansion is about to end
@@ -1325,9 +2620,8 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
     }
 
     // Handle hash operations in parameter expansion context
-    if (in_parameter_expansion(scanner) && lexer->lookahead == '#' &&
-        (valid_symbols[HASH_PATTERN] || valid_symbols[DOUBLE_HASH_PATTERN]) &&
-        !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_HASH_PATTERN) && in_parameter_expansion(scanner) &&
+        lexer->lookahead == '#') {
 #if DEBUG
         fprintf(stderr, "SCANNER: Hash operation detected\n");
 #endif
@@ -1362,8 +2656,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
     }
 
     // Array operators: ${var[*]} and ${var[@]}
-    if ((valid_symbols[ARRAY_STAR_TOKEN] || valid_symbols[ARRAY_AT_TOKEN]) &&
-        !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_ARRAY_OPERATOR)) {
         if (lexer->lookahead == '*' && valid_symbols[ARRAY_STAR_TOKEN] &&
             !valid_symbols[REGEX] && !valid_symbols[REGEX_NO_SLASH] &&
             !valid_symbols[REGEX_NO_SPACE]) {
@@ -1380,8 +2673,8 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
         }
     }
 
-    if (valid_symbols[EMPTY_VALUE]) {
-        if (iswspace(lexer->lookahead) || lexer->eof(lexer) ||
+    if (TRY_HANDLER(H_EMPTY_VALUE)) {
+        if (is_space(lexer->lookahead) || lexer->eof(lexer) ||
             lexer->lookahead == ';' || lexer->lookahead == '&' ||
             lexer->lookahead == '}') {
             lexer->mark_end(lexer);
@@ -1390,35 +2683,29 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
         }
     }
 
-    if ((valid_symbols[HEREDOC_BODY_BEGINNING] ||
-         valid_symbols[SIMPLE_HEREDOC_BODY]) &&
-        scanner->heredocs.size > 0 &&
-        !array_back(&scanner->heredocs)->started &&
-        !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_HEREDOC_BODY) && scanner->heredocs.size > 0 &&
+        !array_back(&scanner->heredocs)->started) {
         return scan_heredoc_content(scanner, lexer, HEREDOC_BODY_BEGINNING,
                                     SIMPLE_HEREDOC_BODY);
     }
 
-    if (valid_symbols[HEREDOC_END] && scanner->heredocs.size > 0) {
+    if (TRY_HANDLER(H_HEREDOC_END) && scanner->heredocs.size > 0) {
         Heredoc *heredoc = array_back(&scanner->heredocs);
         if (scan_heredoc_end_identifier(heredoc, lexer)) {
-            array_delete(&heredoc->current_leading_word);
-            array_delete(&heredoc->delimiter);
+            delete_heredoc(heredoc);
             array_pop(&scanner->heredocs);
             lexer->result_symbol = HEREDOC_END;
             return true;
         }
     }
 
-    if (valid_symbols[HEREDOC_CONTENT] && scanner->heredocs.size > 0 &&
-        array_back(&scanner->heredocs)->started &&
-        !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_HEREDOC_CONTENT) && scanner->heredocs.size > 0 &&
+        array_back(&scanner->heredocs)->started) {
         return scan_heredoc_content(scanner, lexer, HEREDOC_CONTENT,
                                     HEREDOC_END);
     }
 
-    if (valid_symbols[HEREDOC_START] && !in_error_recovery(valid_symbols) &&
-        scanner->heredocs.size > 0) {
+    if (TRY_HANDLER(H_HEREDOC_START) && scanner->heredocs.size > 0) {
 #if DEBUG
         fprintf(stderr,
                 "DEBUG: HEREDOC_START check - heredocs.size=%u, "
@@ -1426,10 +2713,11 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
                 scanner->heredocs.size,
                 in_error_recovery(valid_symbols) ? "true" : "false");
 #endif
-        return scan_heredoc_start(array_back(&scanner->heredocs), lexer);
+        return scan_heredoc_start(scanner, array_back(&scanner->heredocs),
+                                  lexer);
     }
 
-    if (valid_symbols[TEST_OPERATOR] && !valid_symbols[EXPANSION_WORD]) {
+    if (TRY_HANDLER(H_TEST_OPERATOR)) {
         skip_ws(lexer);
         if (lexer->lookahead == '\\') {
             if (valid_symbols[EXTGLOB_PATTERN]) {
@@ -1455,7 +2743,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
                 return false;
             }
 
-            while (iswspace(lexer->lookahead)) {
+            while (is_space(lexer->lookahead)) {
                 skip(lexer);
             }
         }
@@ -1463,7 +2751,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
         if (lexer->lookahead == '\n' && !valid_symbols[NEWLINE]) {
             skip(lexer);
 
-            while (iswspace(lexer->lookahead)) {
+            while (is_space(lexer->lookahead)) {
                 skip(lexer);
             }
         }
@@ -1472,19 +2760,17 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
             advance(lexer);
 
             bool advanced_once = false;
-            while (iswalpha(lexer->lookahead)) {
+            while (is_alpha(lexer->lookahead)) {
                 advanced_once = true;
                 advance(lexer);
             }
 
-            if (iswspace(lexer->lookahead) && advanced_once) {
+            if (is_space(lexer->lookahead) && advanced_once) {
                 lexer->mark_end(lexer);
                 advance(lexer);
                 context_type_t ctx = get_current_context(scanner);
                 if (lexer->lookahead == '}' &&
-                    (ctx == CTX_PARAMETER ||
-                     ctx == CTX_PARAMETER_PATTERN_SUFFIX ||
-                     ctx == CTX_PARAMETER_PATTERN_SUBSTITUTE)) {
+                    context_is(ctx, CONTEXT_PARAMETER)) {
                     if (valid_symbols[EXPANSION_WORD]) {
                         lexer->mark_end(lexer);
                         lexer->result_symbol = EXPANSION_WORD;
@@ -1495,7 +2781,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
                 lexer->result_symbol = TEST_OPERATOR;
                 return true;
             }
-            if (iswspace(lexer->lookahead) && valid_symbols[EXTGLOB_PATTERN]) {
+            if (is_space(lexer->lookahead) && valid_symbols[EXTGLOB_PATTERN]) {
                 lexer->result_symbol = EXTGLOB_PATTERN;
                 return true;
             }
@@ -1507,8 +2793,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
         }
     }
 
-    if (valid_symbols[SIMPLE_VARIABLE_NAME] &&
-        !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_SIMPLE_VARIABLE_NAME)) {
         bool in_param_expand = in_parameter_expansion_context(scanner);
 
 #if DEBUG
@@ -1516,9 +2801,9 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
 #endif
 
         skip_ws(lexer);
-        if (iswalpha(lexer->lookahead) || lexer->lookahead == '_') {
+        if (is_alpha(lexer->lookahead) || lexer->lookahead == '_') {
             int consumed = 0;
-            while (iswalnum(lexer->lookahead) || lexer->lookahead == '_') {
+            while (is_alnum(lexer->lookahead) || lexer->lookahead == '_') {
                 advance(lexer);
                 consumed++;
             }
@@ -1537,8 +2822,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
         }
     }
 
-    if (valid_symbols[SPECIAL_VARIABLE_NAME] &&
-        !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_SPECIAL_VARIABLE_NAME)) {
         // '*', '@', '?', '!', '#', '-', '$', '0', '_'
         skip_ws(lexer);
         bool in_param_expand = in_parameter_expansion_context(scanner);
@@ -1554,7 +2838,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
             (lexer->lookahead == '!' && !in_param_expand) ||
             (lexer->lookahead == '#' && !in_param_expand) ||
             lexer->lookahead == '$' || lexer->lookahead == '_' ||
-            iswdigit(lexer->lookahead)) {
+            is_digit(lexer->lookahead)) {
             advance(lexer);
             lexer->mark_end(lexer);
             was_just_bare_dollar = scanner->just_returned_bare_dollar = false;
@@ -1565,9 +2849,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
         }
     }
 
-    if ((valid_symbols[VARIABLE_NAME] || valid_symbols[FILE_DESCRIPTOR] ||
-         valid_symbols[HEREDOC_ARROW]) &&
-        !valid_symbols[REGEX_NO_SLASH] && !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_VARIABLE_NAME)) {
         for (;;) {
             if ((lexer->lookahead == ' ' || lexer->lookahead == '\t' ||
                  lexer->lookahead == '\r' ||
@@ -1623,7 +2905,7 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
                 lexer->lookahead == '%' || lexer->lookahead == '/') {
                 return false;
             }
-            if (valid_symbols[EXTGLOB_PATTERN] && iswspace(lexer->lookahead)) {
+            if (valid_symbols[EXTGLOB_PATTERN] && is_space(lexer->lookahead)) {
                 lexer->mark_end(lexer);
                 lexer->result_symbol = EXTGLOB_PATTERN;
                 return true;
@@ -1663,332 +2945,140 @@ static bool scan(Scanner *scanner, TSLexer *lexer, const bool *valid_symbols) {
             }
             return false;
         }
-
-        bool is_number = true;
-        if (iswdigit(lexer->lookahead)) {
-            advance(lexer);
-        } else if (iswalpha(lexer->lookahead) || lexer->lookahead == '_') {
-            is_number = false;
-            advance(lexer);
-        } else {
-            if (lexer->lookahead == '{') {
-                goto brace_start;
-            }
-            if (valid_symbols[EXPANSION_WORD]) {
-                goto expansion_word;
-            }
-            if (valid_symbols[EXTGLOB_PATTERN]) {
-                goto extglob_pattern;
-            }
-            return false;
-        }
-
-        for (;;) {
-            if (iswdigit(lexer->lookahead)) {
-                advance(lexer);
-            } else if (iswalpha(lexer->lookahead) || lexer->lookahead == '_') {
-                is_number = false;
-                advance(lexer);
-            } else {
-                break;
-            }
-        }
-
-        if (is_number && valid_symbols[FILE_DESCRIPTOR] &&
-            (lexer->lookahead == '>' || lexer->lookahead == '<')) {
-            lexer->result_symbol = FILE_DESCRIPTOR;
-            return true;
-        }
-
-        if (valid_symbols[VARIABLE_NAME]) {
-            if (lexer->lookahead == '+') {
-                lexer->mark_end(lexer);
-                advance(lexer);
-                context_type_t ctx = get_current_context(scanner);
-                if (lexer->lookahead == '=' || lexer->lookahead == ':' ||
-                    (ctx == CTX_PARAMETER ||
-                     ctx == CTX_PARAMETER_PATTERN_SUFFIX ||
-                     ctx == CTX_PARAMETER_PATTERN_SUBSTITUTE)) {
-#if DEBUG
-                    fprintf(stderr,
-                            "SCANNER: VARIABLE_NAME after + operator\n");
-#endif
-                    lexer->result_symbol = VARIABLE_NAME;
-                    was_just_bare_dollar = scanner->just_returned_bare_dollar =
-                        false;
-                    scanner->just_returned_variable_name = true;
-                    return true;
-                }
-                return false;
-            }
-            if (lexer->lookahead == '/') {
-                return false;
-            }
-            context_type_t ctx = get_current_context(scanner);
-            if (lexer->lookahead == '=' || lexer->lookahead == '[' ||
-                lexer->lookahead == '%' ||
-                (lexer->lookahead == '#' && !is_number) ||
-                lexer->lookahead == '@' ||
-                (lexer->lookahead == '-' &&
-                 (ctx == CTX_PARAMETER || ctx == CTX_PARAMETER_PATTERN_SUFFIX ||
-                  ctx == CTX_PARAMETER_PATTERN_SUBSTITUTE))) {
-                lexer->mark_end(lexer);
-#if DEBUG
-                fprintf(stderr, "SCANNER: VARIABLE_NAME after =\n");
-#endif
-                lexer->result_symbol = VARIABLE_NAME;
-                was_just_bare_dollar = scanner->just_returned_bare_dollar =
-                    false;
-                scanner->just_returned_variable_name = true;
-                return true;
-            }
-
-            if (lexer->lookahead == '?') {
-                lexer->mark_end(lexer);
-                advance(lexer);
-                lexer->result_symbol = VARIABLE_NAME;
-                was_just_bare_dollar = scanner->just_returned_bare_dollar =
-                    false;
-#if DEBUG
-                fprintf(stderr, "SCANNER: VARIABLE_NAME after ?\n");
-#endif
-                scanner->just_returned_variable_name = true;
-                return iswalpha(lexer->lookahead);
-            }
-        }
-
-#if DEBUG
-        fprintf(stderr, "DEBUG: expansion word not valud returning false\n");
-#endif
-        return false;
-    }
-
-    if (valid_symbols[BARE_DOLLAR] && !in_error_recovery(valid_symbols) &&
-        scan_raw_dollar(lexer, valid_symbols)) {
-        return true;
-    }
-
-regex:
-    if ((valid_symbols[REGEX] || valid_symbols[REGEX_NO_SLASH] ||
-         valid_symbols[REGEX_NO_SPACE]) &&
-        !in_error_recovery(valid_symbols)) {
-        if (valid_symbols[REGEX] || valid_symbols[REGEX_NO_SPACE]) {
-            while (iswspace(lexer->lookahead)) {
-                skip(lexer);
-            }
-        }
-
-        if ((lexer->lookahead != '"' && lexer->lookahead != '\'') ||
-            ((lexer->lookahead == '$' || lexer->lookahead == '\'') &&
-             valid_symbols[REGEX_NO_SLASH]) ||
-            (lexer->lookahead == '\'' && valid_symbols[REGEX_NO_SPACE])) {
-            typedef struct {
-                bool done;
-                bool advanced_once;
-                bool found_non_alnumdollarunderdash;
-                bool last_was_escape;
-                bool in_single_quote;
-                uint32_t paren_depth;
-                uint32_t bracket_depth;
-                uint32_t brace_depth;
-            } State;
-
-            if (lexer->lookahead == '$' && valid_symbols[REGEX_NO_SLASH]) {
-                lexer->mark_end(lexer);
-                advance(lexer);
-                if (lexer->lookahead == '(') {
-                    return false;
-                }
-            }
-
-#if DEBUG
-        fprintf(stderr, "DEBUG: regex scan start\n");
-#endif
-
-            lexer->mark_end(lexer);
-
-            State state = {false, false, false, false, false, 0, 0, 0};
-            while (!state.done) {
-                switch (lexer->lookahead) {
-                case '\\':
-                    state.last_was_escape = true;
-                    break;
-                case '\0':
-                    return false;
-                case '(':
-                    state.paren_depth++;
-                    state.last_was_escape = false;
-                    break;
-                case '[':
-                    state.bracket_depth++;
-                    state.last_was_escape = false;
-                    break;
-                case '{':
-                    if (!state.last_was_escape) {
-                        state.brace_depth++;
-                    }
-                    state.last_was_escape = false;
-                    break;
-                case ')':
-                    if (state.paren_depth == 0) {
-                        state.done = true;
-                    }
-                    state.paren_depth--;
-                    state.last_was_escape = false;
-                    break;
-                case ']':
-                    if (state.bracket_depth == 0) {
-                        state.done = true;
-                    }
-                    state.bracket_depth--;
-                    state.last_was_escape = false;
-                    break;
-                case '}':
-                    if (state.brace_depth == 0) {
-                        state.done = true;
-                    }
-                    state.brace_depth--;
-                    state.last_was_escape = false;
-                    break;
-                case '\'':
-                    // Enter or exit a single-quoted string.
-                    if (state.in_single_quote) {
-                        state.in_single_quote = false;
-#if DEBUG
-        fprintf(stderr, "DEBUG: regex scan exit raw string\n");
-#endif
-
-                        // Track entering parameter expansion context
-                        exit_context(scanner, CTX_RAW_STRING);
-                    } else {
-                        state.in_single_quote = true;
-#if DEBUG
-        fprintf(stderr, "DEBUG: regex scan entering raw string\n");
-#endif
-
-                        // Track entering parameter expansion context
-                        enter_context(scanner, CTX_RAW_STRING);
-
-                    }
-                    advance(lexer);
-                    lexer->mark_end(lexer);
-                    state.advanced_once = true;
-                    state.last_was_escape = false;
-                    continue;
-                default:
-                    state.last_was_escape = false;
-                    break;
-                }
-
-                if (!state.done) {
-                    if (valid_symbols[REGEX]) {
-                        bool was_space = !state.in_single_quote &&
-                                         iswspace(lexer->lookahead);
-                        advance(lexer);
-                        state.advanced_once = true;
-                        if (!was_space || state.paren_depth > 0) {
-                            lexer->mark_end(lexer);
-                        }
-                    } else if (valid_symbols[REGEX_NO_SLASH]) {
-                        if (lexer->lookahead == '/') {
-                            lexer->mark_end(lexer);
-                            lexer->result_symbol = REGEX_NO_SLASH;
-                            return state.advanced_once;
-                        }
-                        if (lexer->lookahead == '\\') {
-                            advance(lexer);
-                            state.advanced_once = true;
-                            if (!lexer->eof(lexer) && lexer->lookahead != '[') {
-                                advance(lexer);
-                                lexer->mark_end(lexer);
-                            }
-                        } else {
-                            bool was_space = !state.in_single_quote &&
-                                             iswspace(lexer->lookahead);
-                            advance(lexer);
-                            state.advanced_once = true;
-                            if (!was_space) {
-                                lexer->mark_end(lexer);
-                            }
-                        }
-                    } else if (valid_symbols[REGEX_NO_SPACE]) {
-                        if (lexer->lookahead == '\\') {
-                            state.found_non_alnumdollarunderdash = true;
-                            advance(lexer);
-                            if (!lexer->eof(lexer)) {
-                                advance(lexer);
-                            }
-                        } else if (lexer->lookahead == '$') {
-                            lexer->mark_end(lexer);
-                            advance(lexer);
-                            // do not parse a command
-                            // substitution
-                            if (lexer->lookahead == '(') {
-                                return false;
-                            }
-                            // end $ always means regex, e.g.
-                            // 99999999$
-                            if (iswspace(lexer->lookahead)) {
-                                lexer->result_symbol = REGEX_NO_SPACE;
-                                lexer->mark_end(lexer);
-                                return true;
-                            }
-                        } else {
-                            bool was_space = !state.in_single_quote &&
-                                             iswspace(lexer->lookahead);
-                            if (was_space && state.paren_depth == 0) {
-                                lexer->mark_end(lexer);
-                                lexer->result_symbol = REGEX_NO_SPACE;
-                                return state.found_non_alnumdollarunderdash;
-                            }
-                            if (!iswalnum(lexer->lookahead) &&
-                                lexer->lookahead != '$' &&
-                                lexer->lookahead != '-' &&
-                                lexer->lookahead != '_') {
-                                state.found_non_alnumdollarunderdash = true;
-                            }
-                            advance(lexer);
-                        }
-                    }
+
+        bool is_identifier_start = is_digit(lexer->lookahead) ||
+                                   is_alpha(lexer->lookahead) ||
+                                   lexer->lookahead == '_';
+        if (!is_identifier_start) {
+            if (lexer->lookahead == '{') {
+                goto brace_start;
+            }
+            if (valid_symbols[EXPANSION_WORD]) {
+                goto expansion_word;
+            }
+            if (valid_symbols[EXTGLOB_PATTERN]) {
+                goto extglob_pattern;
+            }
+            return false;
+        }
+
+        // From here on the only tokens are a FILE_DESCRIPTOR made of digits
+        // and a VARIABLE_NAME, so the word is classified as it is read and
+        // the scan gives up at the first character that rules out both,
+        // instead of reading the whole word and handing it back to the
+        // internal lexer
+        bool wants_name = valid_symbols[VARIABLE_NAME];
+        bool wants_descriptor = valid_symbols[FILE_DESCRIPTOR];
+        bool is_number = true;
+        for (;;) {
+            if (is_digit(lexer->lookahead)) {
+                if (!wants_name && !wants_descriptor) {
+                    return false;
                 }
+            } else if (is_alpha(lexer->lookahead) || lexer->lookahead == '_') {
+                if (!wants_name) {
+                    return false;
+                }
+                is_number = false;
+            } else {
+                break;
             }
+            advance(lexer);
+        }
 
-            lexer->result_symbol =
-                valid_symbols[REGEX_NO_SLASH]   ? REGEX_NO_SLASH
-                : valid_symbols[REGEX_NO_SPACE] ? REGEX_NO_SPACE
-                                                : REGEX;
-            if (valid_symbols[REGEX] && !state.advanced_once) {
+        if (is_number && wants_descriptor &&
+            (lexer->lookahead == '>' || lexer->lookahead == '<')) {
+            lexer->result_symbol = FILE_DESCRIPTOR;
+            return true;
+        }
 
+        if (wants_name) {
+            if (lexer->lookahead == '+') {
+                lexer->mark_end(lexer);
+                advance(lexer);
+                context_type_t ctx = get_current_context(scanner);
+                if (lexer->lookahead == '=' || lexer->lookahead == ':' ||
+                    context_is(ctx, CONTEXT_PARAMETER)) {
 #if DEBUG
-                fprintf(stderr, "DEBUG: regex not valid returning false\n");
+                    fprintf(stderr,
+                            "SCANNER: VARIABLE_NAME after + operator\n");
 #endif
+                    lexer->result_symbol = VARIABLE_NAME;
+                    was_just_bare_dollar = scanner->just_returned_bare_dollar =
+                        false;
+                    scanner->just_returned_variable_name = true;
+                    return true;
+                }
                 return false;
             }
-            if (valid_symbols[REGEX_NO_SPACE] && !state.advanced_once) {
+            if (lexer->lookahead == '/') {
+                return false;
+            }
+            context_type_t ctx = get_current_context(scanner);
+            if (lexer->lookahead == '=' || lexer->lookahead == '[' ||
+                lexer->lookahead == '%' ||
+                (lexer->lookahead == '#' && !is_number) ||
+                lexer->lookahead == '@' ||
+                (lexer->lookahead == '-' &&
+                 context_is(ctx, CONTEXT_PARAMETER))) {
+                lexer->mark_end(lexer);
+#if DEBUG
+                fprintf(stderr, "SCANNER: VARIABLE_NAME after =\n");
+#endif
+                lexer->result_symbol = VARIABLE_NAME;
+                was_just_bare_dollar = scanner->just_returned_bare_dollar =
+                    false;
+                scanner->just_returned_variable_name = true;
+                return true;
+            }
 
+            if (lexer->lookahead == '?') {
+                lexer->mark_end(lexer);
+                advance(lexer);
+                lexer->result_symbol = VARIABLE_NAME;
+                was_just_bare_dollar = scanner->just_returned_bare_dollar =
+                    false;
 #if DEBUG
-                fprintf(stderr, "DEBUG: regex not valid returning false\n");
+                fprintf(stderr, "SCANNER: VARIABLE_NAME after ?\n");
 #endif
-                return false;
+                scanner->just_returned_variable_name = true;
+                return is_alpha(lexer->lookahead);
             }
+        }
 
 #if DEBUG
-        fprintf(stderr, "DEBUG: regex scan returning regex\n");
+        fprintf(stderr, "DEBUG: expansion word not valud returning false\n");
 #endif
+        return false;
+    }
 
-            return true;
+    if (TRY_HANDLER(H_RAW_DOLLAR) && scan_raw_dollar(lexer, valid_symbols)) {
+        return true;
+    }
+
+regex:
+    if (TRY_HANDLER(H_REGEX)) {
+        if (valid_symbols[REGEX] || valid_symbols[REGEX_NO_SPACE]) {
+            while (is_space(lexer->lookahead)) {
+                skip(lexer);
+            }
+        }
+
+        if ((lexer->lookahead != '"' && lexer->lookahead != '\'') ||
+            ((lexer->lookahead == '$' || lexer->lookahead == '\'') &&
+             valid_symbols[REGEX_NO_SLASH]) ||
+            (lexer->lookahead == '\'' && valid_symbols[REGEX_NO_SPACE])) {
+            return scan_regex(scanner, lexer, valid_symbols);
         }
     }
 
 extglob_pattern:
-    if (valid_symbols[EXTGLOB_PATTERN] && !in_error_recovery(valid_symbols) &&
-        !valid_symbols[REGEX] && !valid_symbols[REGEX_NO_SLASH] &&
-        !valid_symbols[REGEX_NO_SPACE] &&
+    if (TRY_HANDLER(H_EXTGLOB_PATTERN) &&
         !in_parameter_expansion_context(
             scanner) // Don't generate EXTGLOB_PATTERN inside ${...}
     ) {
         // first skip ws, then check for ? * + @ !
-        while (iswspace(lexer->lookahead)) {
+        while (is_space(lexer->lookahead)) {
             skip(lexer);
         }
 
@@ -1997,10 +3087,10 @@ extglob_pattern:
             lexer->lookahead == '!' || lexer->lookahead == '-' ||
             lexer->lookahead == ')' || lexer->lookahead == '\\' ||
             lexer->lookahead == '.' || lexer->lookahead == '[' ||
-            (iswalpha(lexer->lookahead))) {
+            (is_alpha(lexer->lookahead))) {
             if (lexer->lookahead == '\\') {
                 advance(lexer);
-                if ((iswspace(lexer->lookahead) || lexer->lookahead == '"') &&
+                if ((is_space(lexer->lookahead) || lexer->lookahead == '"') &&
                     lexer->lookahead != '\r' && lexer->lookahead != '\n') {
                     advance(lexer);
                 } else {
@@ -2013,13 +3103,13 @@ extglob_pattern:
                 lexer->mark_end(lexer);
                 advance(lexer);
 
-                if (iswspace(lexer->lookahead)) {
+                if (is_space(lexer->lookahead)) {
                     return false;
                 }
             }
 
             lexer->mark_end(lexer);
-            bool was_non_alpha = !iswalpha(lexer->lookahead);
+            bool was_non_alpha = !is_alpha(lexer->lookahead);
             if (lexer->lookahead != '[') {
                 // no esac
                 if (lexer->lookahead == 'e') {
@@ -2031,7 +3121,7 @@ extglob_pattern:
                             advance(lexer);
                             if (lexer->lookahead == 'c') {
                                 advance(lexer);
-                                if (iswspace(lexer->lookahead)) {
+                                if (is_space(lexer->lookahead)) {
                                     return false;
                                 }
                             }
@@ -2046,7 +3136,7 @@ extglob_pattern:
             if (lexer->lookahead == '-') {
                 lexer->mark_end(lexer);
                 advance(lexer);
-                while (iswalnum(lexer->lookahead)) {
+                while (is_alnum(lexer->lookahead)) {
                     advance(lexer);
                 }
 
@@ -2062,13 +3152,13 @@ extglob_pattern:
                 scanner->last_glob_paren_depth == 0) {
                 lexer->mark_end(lexer);
                 advance(lexer);
-                if (iswspace(lexer->lookahead)) {
+                if (is_space(lexer->lookahead)) {
                     lexer->result_symbol = EXTGLOB_PATTERN;
                     return was_non_alpha;
                 }
             }
 
-            if (iswspace(lexer->lookahead)) {
+            if (is_space(lexer->lookahead)) {
                 lexer->mark_end(lexer);
                 lexer->result_symbol = EXTGLOB_PATTERN;
                 scanner->last_glob_paren_depth = 0;
@@ -2091,7 +3181,7 @@ extglob_pattern:
                 return true;
             }
 
-            if (!iswalnum(lexer->lookahead) && lexer->lookahead != '(' &&
+            if (!is_alnum(lexer->lookahead) && lexer->lookahead != '(' &&
                 lexer->lookahead != '"' && lexer->lookahead != '[' &&
                 lexer->lookahead != '?' && lexer->lookahead != '/' &&
                 lexer->lookahead != '\\' && lexer->lookahead != '_' &&
@@ -2153,10 +3243,10 @@ extglob_pattern:
                 }
 
                 if (!state.done) {
-                    bool was_space = iswspace(lexer->lookahead);
+                    bool was_space = is_space(lexer->lookahead);
                     if (lexer->lookahead == '$') {
                         lexer->mark_end(lexer);
-                        if (!iswalpha(lexer->lookahead) &&
+                        if (!is_alpha(lexer->lookahead) &&
                             lexer->lookahead != '.' &&
                             lexer->lookahead != '\\') {
                             state.saw_non_alphadot = true;
@@ -2182,18 +3272,18 @@ extglob_pattern:
                         return state.saw_non_alphadot;
                     }
                     if (lexer->lookahead == '\\') {
-                        if (!iswalpha(lexer->lookahead) &&
+                        if (!is_alpha(lexer->lookahead) &&
                             lexer->lookahead != '.' &&
                             lexer->lookahead != '\\') {
                             state.saw_non_alphadot = true;
                         }
                         advance(lexer);
-                        if (iswspace(lexer->lookahead) ||
+                        if (is_space(lexer->lookahead) ||
                             lexer->lookahead == '"') {
                             advance(lexer);
                         }
                     } else {
-                        if (!iswalpha(lexer->lookahead) &&
+                        if (!is_alpha(lexer->lookahead) &&
                             lexer->lookahead != '.' &&
                             lexer->lookahead != '\\') {
                             state.saw_non_alphadot = true;
@@ -2218,7 +3308,7 @@ extglob_pattern:
     }
 
 expansion_word:
-    if (valid_symbols[EXPANSION_WORD]) {
+    if (TRY_HANDLER(H_EXPANSION_WORD)) {
 #if DEBUG
         fprintf(stderr,
                 "DEBUG: EXPANSION_WORD handler called, context=%d, "
@@ -2237,6 +3327,7 @@ expansion_word:
         }
         bool advanced_once = false;
         bool advance_once_space = false;
+        bool crossed_newline = false;
         for (;;) {
             if (lexer->lookahead == '\"') {
                 return false;
@@ -2245,7 +3336,7 @@ expansion_word:
                 lexer->mark_end(lexer);
                 advance(lexer);
                 if (lexer->lookahead == '{' || lexer->lookahead == '(' ||
-                    lexer->lookahead == '\'' || iswalnum(lexer->lookahead)) {
+                    lexer->lookahead == '\'' || is_alnum(lexer->lookahead)) {
                     lexer->result_symbol = EXPANSION_WORD;
                     return true;
                 }
@@ -2281,7 +3372,7 @@ expansion_word:
                         if (lexer->lookahead == '{' ||
                             lexer->lookahead == '(' ||
                             lexer->lookahead == '\'' ||
-                            iswalnum(lexer->lookahead)) {
+                            is_alnum(lexer->lookahead)) {
                             lexer->result_symbol = EXPANSION_WORD;
                             return true;
                         }
@@ -2314,10 +3405,13 @@ expansion_word:
                                 return true;
                             }
                         }
+                        if (lexer->lookahead == '\n') {
+                            return false;
+                        }
                         advanced_once =
-                            advanced_once || !iswspace(lexer->lookahead);
+                            advanced_once || !is_space(lexer->lookahead);
                         advance_once_space =
-                            advance_once_space || iswspace(lexer->lookahead);
+                            advance_once_space || is_space(lexer->lookahead);
                         advance(lexer);
                     }
                 }
@@ -2378,9 +3472,19 @@ expansion_word:
                 }
             }
 
-            advanced_once = advanced_once || !iswspace(lexer->lookahead);
+            // The word ends with its line, or an expansion that is never
+            // closed would be read to the end of the input from every
+            // position it is tried at. Only the blank rest of a line, as in
+            // `${name:` followed by a newline and `}`, goes on to the next.
+            if (lexer->lookahead == '\n') {
+                if (advanced_once || crossed_newline) {
+                    return false;
+                }
+                crossed_newline = true;
+            }
+            advanced_once = advanced_once || !is_space(lexer->lookahead);
             advance_once_space =
-                advance_once_space || iswspace(lexer->lookahead);
+                advance_once_space || is_space(lexer->lookahead);
             advance(lexer);
         }
     } else {
@@ -2391,7 +3495,7 @@ expansion_word:
 
 // This handles ranges in braces
 brace_start:
-    if (valid_symbols[BRACE_EXPR_START] && !in_error_recovery(valid_symbols)) {
+    if (TRY_HANDLER(H_BRACE_EXPR_START)) {
         skip_ws(lexer);
 
         if (lexer->lookahead == '{') {
@@ -2436,11 +3540,31 @@ brace_start:
     return false;
 }
 
-void *tree_sitter_zsh_external_scanner_create() {
+#ifdef TREE_SITTER_ZSH_SCANNER_POOL
+
+// Destroyed scanners are kept per thread and handed out again by the next
+// create, so parser churn reuses the Scanner and the capacity of its arrays
+// instead of going back to the allocator. Pooled scanners are reset, and a
+// thread that exits leaves at most SCANNER_POOL_SIZE of them behind.
+#ifndef SCANNER_POOL_SIZE
+#define SCANNER_POOL_SIZE 8
+#endif
+
+static SCANNER_THREAD_LOCAL Scanner *scanner_pool[SCANNER_POOL_SIZE];
+static SCANNER_THREAD_LOCAL uint32_t scanner_pool_size;
+
+#endif
+
+SCANNER_PUBLIC
+void *LANGUAGE_FUNCTION(external_scanner_create)() {
+#ifdef TREE_SITTER_ZSH_SCANNER_POOL
+    if (scanner_pool_size > 0) {
+        return scanner_pool[--scanner_pool_size];
+    }
+#endif
     Scanner *scanner = calloc(1, sizeof(Scanner));
     UINT32_MAX; // Initialize to invalid position
     array_init(&scanner->heredocs);
-    array_init(&scanner->context_stack);
 #if DEBUG
     fprintf(
         stderr,
@@ -2450,33 +3574,758 @@ void *tree_sitter_zsh_external_scanner_create() {
     return scanner;
 }
 
-bool tree_sitter_zsh_external_scanner_scan(void *payload, TSLexer *lexer,
-                                           const bool *valid_symbols) {
+SCANNER_PUBLIC
+bool LANGUAGE_FUNCTION(external_scanner_scan)(void *payload, TSLexer *lexer,
+                                              const bool *valid_symbols) {
     Scanner *scanner = (Scanner *)payload;
-    return scan(scanner, lexer, valid_symbols);
+#ifdef TREE_SITTER_ZSH_SCANNER_STATS
+    stats_scans++;
+#endif
+#ifdef TREE_SITTER_ZSH_SCANNER_TRACE
+    trace_scan_start(scanner);
+#endif
+    bool result = scan(scanner, lexer, valid_symbols);
+#ifdef TREE_SITTER_ZSH_SCANNER_STATS
+    stats_finish_handler(result);
+#endif
+#ifdef TREE_SITTER_ZSH_SCANNER_TRACE
+    trace_scan_end(scanner, lexer, result);
+#endif
+    return result;
 }
 
-unsigned tree_sitter_zsh_external_scanner_serialize(void *payload,
-                                                    char *state) {
+SCANNER_PUBLIC
+unsigned LANGUAGE_FUNCTION(external_scanner_serialize)(void *payload,
+                                                       char *state) {
     Scanner *scanner = (Scanner *)payload;
     return serialize(scanner, state);
 }
 
-void tree_sitter_zsh_external_scanner_deserialize(void *payload,
-                                                  const char *state,
-                                                  unsigned length) {
+SCANNER_PUBLIC
+void LANGUAGE_FUNCTION(external_scanner_deserialize)(void *payload,
+                                                     const char *state,
+                                                     unsigned length) {
     Scanner *scanner = (Scanner *)payload;
     deserialize(scanner, state, length);
 }
 
-void tree_sitter_zsh_external_scanner_destroy(void *payload) {
+SCANNER_PUBLIC
+void LANGUAGE_FUNCTION(external_scanner_destroy)(void *payload) {
     Scanner *scanner = (Scanner *)payload;
+#ifdef TREE_SITTER_ZSH_SCANNER_TRACE
+    if (trace_scanner == scanner) {
+        trace_scanner = NULL;
+    }
+    scanner->trace.count = 0;
+#endif
+#ifdef TREE_SITTER_ZSH_SCANNER_POOL
+    if (scanner_pool_size < SCANNER_POOL_SIZE) {
+        reset(scanner);
+        scanner_pool[scanner_pool_size++] = scanner;
+        return;
+    }
+#endif
     for (size_t i = 0; i < scanner->heredocs.size; i++) {
-        Heredoc *heredoc = array_get(&scanner->heredocs, i);
-        array_delete(&heredoc->current_leading_word);
-        array_delete(&heredoc->delimiter);
+        delete_heredoc(array_get(&scanner->heredocs, i));
     }
     array_delete(&scanner->heredocs);
-    array_delete(&scanner->context_stack);
+#ifdef TREE_SITTER_ZSH_HEREDOC_ARENA
+    arena_delete(&scanner->arena);
+    array_delete(&scanner->word);
+#endif
+    context_stack_delete(&scanner->context_stack);
     free(scanner);
 }
+
+// Same layout as the declarations in
+// bindings/c/tree_sitter/tree-sitter-zsh.h
+typedef struct {
+    const char *name;
+    uint64_t invocations;
+    uint64_t accepts;
+    uint64_t rejects;
+    uint64_t characters;
+    uint64_t backtracks;
+    uint64_t backtracked_characters;
+} TSZshHandlerStats;
+
+typedef struct {
+    uint64_t scans;
+    uint32_t max_context_depth;
+    uint32_t handler_count;
+} TSZshScannerStats;
+
+SCANNER_PUBLIC
+bool LANGUAGE_FUNCTION(scanner_stats)(TSZshScannerStats *stats,
+                                      TSZshHandlerStats *handlers,
+                                      uint32_t handler_capacity) {
+#ifdef TREE_SITTER_ZSH_SCANNER_STATS
+    stats->scans = stats_scans;
+    stats->max_context_depth = stats_max_context_depth;
+    stats->handler_count = HANDLER_COUNT;
+    for (uint32_t i = 0; i < HANDLER_COUNT && i < handler_capacity; i++) {
+        handlers[i].name = HandlerNames[i];
+        handlers[i].invocations = stats_handlers[i].invocations;
+        handlers[i].accepts = stats_handlers[i].accepts;
+        handlers[i].rejects = stats_handlers[i].rejects;
+        handlers[i].characters = stats_handlers[i].characters;
+        handlers[i].backtracks = stats_handlers[i].backtracks;
+        handlers[i].backtracked_characters =
+            stats_handlers[i].backtracked_characters;
+    }
+    return true;
+#else
+    (void)handlers;
+    (void)handler_capacity;
+    memset(stats, 0, sizeof(*stats));
+    return false;
+#endif
+}
+
+SCANNER_PUBLIC
+void LANGUAGE_FUNCTION(scanner_stats_reset)(void) {
+#ifdef TREE_SITTER_ZSH_SCANNER_STATS
+    memset(stats_handlers, 0, sizeof(stats_handlers));
+    stats_scans = 0;
+    scan_characters = 0;
+    stats_max_context_depth = 0;
+    stats_handler = HANDLER_COUNT;
+#endif
+}
+
+/**
+ * Trace export format, all integers little-endian:
+ *
+ *   "ZSTR"             4 bytes
+ *   version            1 byte, TRACE_FORMAT_VERSION
+ *   reserved           3 bytes, zero
+ *   event count        4 bytes
+ *   events             8 bytes each, oldest first: handler, symbol, context,
+ *                      depth, then the 4-byte offset
+ */
+#define TRACE_FORMAT_VERSION 1
+#define TRACE_HEADER_SIZE 12
+#define TRACE_EVENT_SIZE 8
+
+static inline void write_le32(char *buffer, uint32_t value) {
+    buffer[0] = (char)(value & 0xff);
+    buffer[1] = (char)((value >> 8) & 0xff);
+    buffer[2] = (char)((value >> 16) & 0xff);
+    buffer[3] = (char)(value >> 24);
+}
+
+SCANNER_PUBLIC
+uint32_t LANGUAGE_FUNCTION(scanner_trace)(char *buffer, uint32_t size) {
+#ifdef TREE_SITTER_ZSH_SCANNER_TRACE
+    if (!trace_scanner) {
+        return 0;
+    }
+    TraceRing *ring = &trace_scanner->trace;
+    uint32_t count =
+        ring->count < SCANNER_TRACE_SIZE ? ring->count : SCANNER_TRACE_SIZE;
+    uint32_t needed = TRACE_HEADER_SIZE + count * TRACE_EVENT_SIZE;
+    if (!buffer || size < needed) {
+        return needed;
+    }
+    memcpy(buffer, "ZSTR", 4);
+    buffer[4] = TRACE_FORMAT_VERSION;
+    buffer[5] = buffer[6] = buffer[7] = 0;
+    write_le32(buffer + 8, count);
+    char *output = buffer + TRACE_HEADER_SIZE;
+    for (uint32_t i = ring->count - count; i != ring->count; i++) {
+        const TraceEvent *event = &ring->events[i % SCANNER_TRACE_SIZE];
+        output[0] = (char)event->handler;
+        output[1] = (char)event->symbol;
+        output[2] = (char)event->context;
+        output[3] = (char)event->depth;
+        write_le32(output + 4, event->offset);
+        output += TRACE_EVENT_SIZE;
+    }
+    return needed;
+#else
+    (void)buffer;
+    (void)size;
+    return 0;
+#endif
+}
+
+/**
+ * Top-level statement splitting.
+ *
+ * A pre-pass over a whole source that finds the line starts at which a
+ * top-level statement begins, so that a large file can be parsed in pieces.
+ * It follows what the scanner relies on at a statement boundary: quotes, the
+ * nesting of $( ), ${ }, ( ), { }, (( )) and [[ ]], open if, case and loop
+ * bodies, and pending heredocs, whose bodies it skips. A line start is only a
+ * split point when all of those are closed, the line before does not end in
+ * a pipe or && or ||, and the line does not open with something that belongs
+ * to the statement before, such as a function body or `then`. On anything it
+ * cannot follow, the pass stops rather than guess.
+ *
+ * The external scanner cannot drive the pass, since it needs the parser's
+ * valid_symbols to decide anything, but the pass keeps its state in a Scanner
+ * of its own. Quotes and brackets are entered on the scanner's context stack
+ * as the contexts the scanner enters for them, and heredoc delimiters are read
+ * and matched by the scanner's own functions through a TSLexer over the
+ * source, so a heredoc ends on the line where the scanner ends it and the
+ * split point is empty exactly when the scanner's state would be. The compound
+ * commands, which only the parser follows, are pushed as contexts of their
+ * own.
+ */
+
+// The contexts only the splitter enters
+typedef enum {
+    SPLIT_IF = CTX_RAW_STRING + 1,
+    SPLIT_CASE,
+    SPLIT_LOOP,
+    SPLIT_FOREACH,
+} SplitContext;
+
+typedef struct {
+    const char *source;
+    uint32_t length;
+    uint32_t position;
+    // The context stack and pending heredocs
+    Scanner *scanner;
+    // Whether the next word is in command position, where keywords count
+    bool command_position;
+    // Whether the line so far ends in | |& && or ||
+    bool continues;
+    bool failed;
+} Splitter;
+
+// A TSLexer over the source of a Splitter, for handing to the scanner's
+// functions. It has a position of its own, so that the splitter itself never
+// escapes and stays in registers.
+typedef struct {
+    TSLexer lexer;
+    const char *source;
+    uint32_t length;
+    uint32_t position;
+} SplitLexer;
+
+static inline char split_peek(const Splitter *splitter, uint32_t offset) {
+    uint32_t position = splitter->position + offset;
+    return position < splitter->length ? splitter->source[position] : '\0';
+}
+
+static inline int32_t split_lexer_lookahead(const SplitLexer *lexer) {
+    return lexer->position < lexer->length
+               ? (unsigned char)lexer->source[lexer->position]
+               : 0;
+}
+
+static void split_lexer_advance(TSLexer *lexer, bool skip) {
+    (void)skip;
+    SplitLexer *split_lexer = (SplitLexer *)lexer;
+    if (split_lexer->position < split_lexer->length) {
+        split_lexer->position++;
+    }
+    lexer->lookahead = split_lexer_lookahead(split_lexer);
+}
+
+static void split_lexer_mark_end(TSLexer *lexer) { (void)lexer; }
+
+static uint32_t split_lexer_get_column(TSLexer *lexer) {
+    const SplitLexer *split_lexer = (const SplitLexer *)lexer;
+    uint32_t start = split_lexer->position;
+    while (start > 0 && split_lexer->source[start - 1] != '\n') {
+        start--;
+    }
+    return split_lexer->position - start;
+}
+
+static bool split_lexer_is_at_included_range_start(const TSLexer *lexer) {
+    (void)lexer;
+    return false;
+}
+
+static bool split_lexer_eof(const TSLexer *lexer) {
+    const SplitLexer *split_lexer = (const SplitLexer *)lexer;
+    return split_lexer->position >= split_lexer->length;
+}
+
+static void split_lexer_log(const TSLexer *lexer, const char *format, ...) {
+    (void)lexer;
+    (void)format;
+}
+
+// Starts `lexer` at the current position of `splitter`
+static void split_lexer_init(SplitLexer *lexer, const Splitter *splitter) {
+    lexer->lexer.result_symbol = 0;
+    lexer->lexer.advance = split_lexer_advance;
+    lexer->lexer.mark_end = split_lexer_mark_end;
+    lexer->lexer.get_column = split_lexer_get_column;
+    lexer->lexer.is_at_included_range_start =
+        split_lexer_is_at_included_range_start;
+    lexer->lexer.eof = split_lexer_eof;
+    lexer->lexer.log = split_lexer_log;
+    lexer->source = splitter->source;
+    lexer->length = splitter->length;
+    lexer->position = splitter->position;
+    lexer->lexer.lookahead = split_lexer_lookahead(lexer);
+}
+
+static inline bool split_is_blank(char c) { return c == ' ' || c == '\t'; }
+
+// Whether `c` ends a word in command position
+static inline bool split_is_delimiter(char c) {
+    return c == '\0' || c == '\n' || split_is_blank(c) || c == ';' ||
+           c == '&' || c == '|' || c == '(' || c == ')' || c == '<' ||
+           c == '>';
+}
+
+// Whether `c` can only be part of a word, so that runs of them are skipped
+static inline bool split_is_plain(char c) {
+    return !split_is_delimiter(c) && c != '"' && c != '\'' && c != '`' &&
+           c != '$' && c != '\\' && c != '{' && c != '}' && c != '[' &&
+           c != ']' && c != '#';
+}
+
+// The innermost context, CTX_NONE at the top level
+static inline uint8_t split_top(const Splitter *splitter) {
+    return splitter->scanner->context_stack.top;
+}
+
+static inline void split_push(Splitter *splitter, uint8_t context) {
+    context_stack_push(&splitter->scanner->context_stack,
+                       (context_type_t)context);
+}
+
+// Closes `context`, which must be the innermost one
+static inline void split_pop(Splitter *splitter, uint8_t context) {
+    if (split_top(splitter) != context) {
+        splitter->failed = true;
+        return;
+    }
+    context_stack_pop(&splitter->scanner->context_stack);
+}
+
+static inline bool split_word_is(const char *word, uint32_t length,
+                                 const char *keyword) {
+    return strlen(keyword) == length && memcmp(word, keyword, length) == 0;
+}
+
+// Skips a quoted string whose opening quote has been consumed, up to and
+// including the closing `quote`, honoring backslashes when `escapes` is set
+static void split_skip_quoted(Splitter *splitter, char quote, bool escapes) {
+    while (splitter->position < splitter->length) {
+        char c = splitter->source[splitter->position++];
+        if (c == quote) {
+            return;
+        }
+        if (c == '\\' && escapes) {
+            splitter->position++;
+        }
+    }
+}
+
+// Reads the delimiter of a heredoc after `<<`, as the scanner does for the
+// HEREDOC_ARROW or HEREDOC_ARROW_DASH and HEREDOC_START tokens
+static void split_heredoc_start(Splitter *splitter) {
+    Scanner *scanner = splitter->scanner;
+    Heredoc heredoc = heredoc_new();
+    heredoc.allows_indent = split_peek(splitter, 0) == '-';
+    if (heredoc.allows_indent) {
+        splitter->position++;
+    }
+    array_push(&scanner->heredocs, heredoc);
+    SplitLexer lexer;
+    split_lexer_init(&lexer, splitter);
+    splitter->failed = !scan_heredoc_start(
+        scanner, array_back(&scanner->heredocs), &lexer.lexer);
+    splitter->position = lexer.position;
+}
+
+// Skips the bodies of the pending heredocs, from the start of the line after
+// the one that started them. Like the scanner, a body ends on the first line
+// that starts with its delimiter after any indentation.
+static void split_heredoc_bodies(Splitter *splitter) {
+    Scanner *scanner = splitter->scanner;
+    for (uint32_t i = 0; i < scanner->heredocs.size; i++) {
+        Heredoc *heredoc = array_get(&scanner->heredocs, i);
+        bool found = false;
+        while (!found && splitter->position < splitter->length) {
+            while (split_is_blank(split_peek(splitter, 0))) {
+                splitter->position++;
+            }
+            // Most lines are rejected on their first character, as in the
+            // scanner, before a lexer is set up to match the whole delimiter
+            if ((unsigned char)split_peek(splitter, 0) ==
+                heredoc->delimiter_first) {
+                SplitLexer lexer;
+                split_lexer_init(&lexer, splitter);
+                found = scan_heredoc_end_identifier(heredoc, &lexer.lexer);
+                splitter->position = lexer.position;
+            }
+            const char *line = splitter->source + splitter->position;
+            const char *end =
+                memchr(line, '\n', splitter->length - splitter->position);
+            splitter->position =
+                end ? (uint32_t)(end - splitter->source) + 1 : splitter->length;
+        }
+    }
+    truncate_heredocs(scanner, 0);
+#ifdef TREE_SITTER_ZSH_HEREDOC_ARENA
+    arena_reset(&scanner->arena);
+#endif
+}
+
+// Whether the line at the current position can start a new statement. Blank
+// and comment lines belong to whatever follows them, so they are skipped.
+static bool split_line_starts_statement(const Splitter *splitter) {
+    uint32_t position = splitter->position;
+    for (;;) {
+        while (position < splitter->length &&
+               split_is_blank(splitter->source[position])) {
+            position++;
+        }
+        if (position == splitter->length) {
+            return false;
+        }
+        if (splitter->source[position] != '\n' &&
+            splitter->source[position] != '#') {
+            break;
+        }
+        const char *end = memchr(splitter->source + position, '\n',
+                                 splitter->length - position);
+        if (!end) {
+            return false;
+        }
+        position = (uint32_t)(end - splitter->source) + 1;
+    }
+
+    char c = splitter->source[position];
+    if (c == '{' || c == '}' || c == '(' || c == ')' || c == '|' ||
+        c == '&' || c == ';') {
+        return false;
+    }
+    const char *word = splitter->source + position;
+    uint32_t length = 0;
+    while (position + length < splitter->length &&
+           !split_is_delimiter(word[length])) {
+        length++;
+    }
+    static const char *const continuations[] = {
+        "then", "elif", "else", "fi",  "do",     "done",
+        "esac", "in",   "end",  "always",
+    };
+    for (size_t i = 0; i < sizeof(continuations) / sizeof(*continuations);
+         i++) {
+        if (split_word_is(word, length, continuations[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Consumes a word in command position, opening or closing the compound
+// command it is a keyword of
+static void split_command_word(Splitter *splitter) {
+    const char *word = splitter->source + splitter->position;
+    uint32_t length = 0;
+    while (split_is_plain(split_peek(splitter, length))) {
+        length++;
+    }
+    splitter->position += length;
+    char next = split_peek(splitter, 0);
+    bool in_case = split_top(splitter) == SPLIT_CASE;
+    // A case pattern such as `if)` is not a keyword
+    if (!split_is_delimiter(next) || (in_case && (next == ')' || next == '|'))) {
+        splitter->command_position = false;
+        return;
+    }
+
+    splitter->command_position = true;
+    if (split_word_is(word, length, "if")) {
+        split_push(splitter, SPLIT_IF);
+    } else if (split_word_is(word, length, "fi")) {
+        split_pop(splitter, SPLIT_IF);
+        splitter->command_position = false;
+    } else if (split_word_is(word, length, "do")) {
+        split_push(splitter, SPLIT_LOOP);
+    } else if (split_word_is(word, length, "done")) {
+        split_pop(splitter, SPLIT_LOOP);
+        splitter->command_position = false;
+    } else if (split_word_is(word, length, "case")) {
+        split_push(splitter, SPLIT_CASE);
+        splitter->command_position = false;
+    } else if (split_word_is(word, length, "esac")) {
+        split_pop(splitter, SPLIT_CASE);
+        splitter->command_position = false;
+    } else if (split_word_is(word, length, "foreach")) {
+        split_push(splitter, SPLIT_FOREACH);
+        splitter->command_position = false;
+    } else if (split_word_is(word, length, "end") &&
+               split_top(splitter) == SPLIT_FOREACH) {
+        split_pop(splitter, SPLIT_FOREACH);
+        splitter->command_position = false;
+    } else if (!split_word_is(word, length, "then") &&
+               !split_word_is(word, length, "else") &&
+               !split_word_is(word, length, "elif") &&
+               !split_word_is(word, length, "while") &&
+               !split_word_is(word, length, "until") &&
+               !split_word_is(word, length, "!")) {
+        splitter->command_position = false;
+    }
+}
+
+// Consumes a group of glob flags such as (#i) or glob qualifiers such as
+// (#qN), which the scanner reads as ZSH_EXTENDED_GLOB_FLAGS rather than as a
+// subshell and a comment: the flags it accepts and the punctuation of the
+// qualifiers. Anything else after `(#` stops the pass.
+static void split_glob_flags(Splitter *splitter) {
+    uint32_t length = 2;
+    char c = split_peek(splitter, length);
+    while (c && (is_glob_flag((unsigned char)c) || strchr("/*@=%-^+:", c))) {
+        c = split_peek(splitter, ++length);
+    }
+    if (length == 2 || c != ')') {
+        splitter->failed = true;
+        return;
+    }
+    splitter->position += length + 1;
+    splitter->command_position = false;
+    splitter->continues = false;
+}
+
+// Consumes one token inside a double-quoted string
+static void split_double_quoted(Splitter *splitter, char c) {
+    splitter->position++;
+    if (c == '"') {
+        context_stack_pop(&splitter->scanner->context_stack);
+    } else if (c == '\\') {
+        splitter->position++;
+    } else if (c == '`') {
+        split_push(splitter, CTX_BACKTICK);
+    } else if (c == '$' && split_peek(splitter, 0) == '(') {
+        splitter->position++;
+        if (split_peek(splitter, 0) == '(') {
+            splitter->position++;
+            split_push(splitter, CTX_ARITHMETIC);
+        } else {
+            split_push(splitter, CTX_COMMAND);
+            splitter->command_position = true;
+        }
+    } else if (c == '$' && split_peek(splitter, 0) == '{') {
+        splitter->position++;
+        split_push(splitter, CTX_PARAMETER);
+        splitter->command_position = false;
+    }
+}
+
+// Consumes one token of code
+static void split_code(Splitter *splitter, char c) {
+    char next = split_peek(splitter, 1);
+    bool word_start = splitter->position == 0 ||
+                      split_is_delimiter(
+                          splitter->source[splitter->position - 1]);
+    bool continues = false;
+
+    if (split_is_blank(c)) {
+        splitter->position++;
+        return;
+    }
+    if (c == '(' && next == '#') {
+        split_glob_flags(splitter);
+        return;
+    }
+    if (c == '#' && word_start) {
+        const char *end =
+            memchr(splitter->source + splitter->position, '\n',
+                   splitter->length - splitter->position);
+        splitter->position =
+            end ? (uint32_t)(end - splitter->source) : splitter->length;
+        return;
+    }
+
+    bool command_position = false;
+    uint8_t top = split_top(splitter);
+    switch (c) {
+    case '\\':
+        splitter->position += 2;
+        break;
+    case '\'':
+        splitter->position++;
+        split_skip_quoted(splitter, '\'', false);
+        break;
+    case '"':
+        splitter->position++;
+        split_push(splitter, CTX_STRING);
+        break;
+    case '`':
+        splitter->position++;
+        split_push(splitter, CTX_BACKTICK);
+        break;
+    case '$':
+        splitter->position++;
+        if (next == '\'') {
+            splitter->position++;
+            split_skip_quoted(splitter, '\'', true);
+        } else if (next == '(' && split_peek(splitter, 1) == '(') {
+            splitter->position += 2;
+            split_push(splitter, CTX_ARITHMETIC);
+        } else if (next == '(') {
+            splitter->position++;
+            split_push(splitter, CTX_COMMAND);
+            command_position = true;
+        } else if (next == '{') {
+            splitter->position++;
+            split_push(splitter, CTX_PARAMETER);
+        }
+        break;
+    case '(':
+        if (next == '(' && splitter->command_position) {
+            splitter->position += 2;
+            split_push(splitter, CTX_ARITHMETIC);
+        } else {
+            // A subshell is a command list closed by ')' like $( )
+            splitter->position++;
+            split_push(splitter, CTX_COMMAND);
+            command_position = true;
+        }
+        break;
+    case ')':
+        splitter->position++;
+        if (top == CTX_ARITHMETIC && next == ')') {
+            splitter->position++;
+            split_pop(splitter, CTX_ARITHMETIC);
+        } else if (top == SPLIT_CASE) {
+            // The end of a case pattern
+            command_position = true;
+        } else {
+            split_pop(splitter, CTX_COMMAND);
+        }
+        break;
+    case '{':
+        splitter->position++;
+        split_push(splitter, CTX_COMPOUND);
+        command_position = word_start && split_is_delimiter(next);
+        break;
+    case '}':
+        splitter->position++;
+        if (top == CTX_PARAMETER || top == CTX_COMPOUND) {
+            split_pop(splitter, top);
+        }
+        break;
+    case '[':
+        if (next == '[' && splitter->command_position) {
+            splitter->position += 2;
+            split_push(splitter, CTX_TEST);
+        } else {
+            splitter->position++;
+        }
+        break;
+    case ']':
+        if (next == ']' && top == CTX_TEST) {
+            splitter->position += 2;
+            split_pop(splitter, CTX_TEST);
+        } else {
+            splitter->position++;
+        }
+        break;
+    case '<':
+        if (next == '<' && split_peek(splitter, 2) == '<') {
+            splitter->position += 3;
+        } else if (next == '<' && top != CTX_ARITHMETIC && top != CTX_TEST) {
+            splitter->position += 2;
+            split_heredoc_start(splitter);
+        } else {
+            splitter->position++;
+        }
+        command_position = splitter->command_position;
+        break;
+    case '>':
+        splitter->position++;
+        command_position = splitter->command_position;
+        break;
+    case '|':
+        splitter->position += next == '|' || next == '&' ? 2 : 1;
+        continues = true;
+        command_position = true;
+        break;
+    case '&':
+        splitter->position += next == '&' || next == '|' || next == '!' ||
+                                      next == '>'
+                                  ? 2
+                                  : 1;
+        continues = next == '&';
+        command_position = next != '>';
+        break;
+    case ';':
+        splitter->position += next == ';' || next == '&' || next == '|' ? 2
+                                                                        : 1;
+        command_position = true;
+        break;
+    default:
+        if (splitter->command_position && split_is_plain(c)) {
+            splitter->continues = false;
+            split_command_word(splitter);
+            return;
+        }
+        do {
+            splitter->position++;
+        } while (split_is_plain(split_peek(splitter, 0)));
+        break;
+    }
+    splitter->continues = continues;
+    splitter->command_position = command_position;
+}
+
+SCANNER_PUBLIC
+uint32_t LANGUAGE_FUNCTION(split_points)(const char *source, uint32_t length,
+                                         uint32_t chunk_size, uint32_t *points,
+                                         uint32_t capacity) {
+    Splitter splitter;
+    splitter.source = source;
+    splitter.length = length;
+    splitter.position = 0;
+    splitter.scanner = LANGUAGE_FUNCTION(external_scanner_create)();
+    splitter.command_position = true;
+    splitter.continues = false;
+    splitter.failed = false;
+    const ContextStack *contexts = &splitter.scanner->context_stack;
+    const uint32_t *heredocs = &splitter.scanner->heredocs.size;
+
+    uint32_t count = 0;
+    uint32_t next_split = chunk_size;
+    while (splitter.position < length && count < capacity &&
+           !splitter.failed) {
+        char c = source[splitter.position];
+        switch (split_top(&splitter)) {
+        case CTX_STRING:
+            splitter.failed = c == '\n' && *heredocs > 0;
+            split_double_quoted(&splitter, c);
+            continue;
+        case CTX_BACKTICK:
+            // Heredocs started inside a backtick substitution are not followed
+            splitter.failed = c == '\n' && *heredocs > 0;
+            splitter.position += c == '\\' ? 2 : 1;
+            if (c == '`') {
+                split_pop(&splitter, CTX_BACKTICK);
+            }
+            continue;
+        default:
+            break;
+        }
+        if (c != '\n') {
+            split_code(&splitter, c);
+            continue;
+        }
+
+        splitter.position++;
+        if (*heredocs > 0) {
+            split_heredoc_bodies(&splitter);
+        }
+        if (contexts->size == 0 && !splitter.continues &&
+            splitter.position >= next_split &&
+            split_line_starts_statement(&splitter)) {
+            points[count++] = splitter.position;
+            next_split = splitter.position + chunk_size;
+        }
+        // `continues` is kept, since a pipeline can go on after blank lines
+        splitter.command_position = true;
+    }
+    LANGUAGE_FUNCTION(external_scanner_destroy)(splitter.scanner);
+    return count;
+}